@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Memory functions the allocations of a file or an output go through, NULL standing for the C library's
+typedef struct Allocator
+{
+    void *(*allocate)(void *context, size_t size);
+    void *(*reallocate)(void *context, void *pointer, size_t size);
+    void (*release)(void *context, void *pointer);
+    void *context;
+} Allocator;
+
+/**
+ * Allocates memory.
+ *
+ * @param allocator The allocator, or NULL for the C library's.
+ * @param size The number of bytes.
+ * @return The memory, or NULL.
+ */
+void *memory_allocate(const Allocator *allocator, size_t size)
+{
+    if (!allocator)
+        return malloc(size);
+    return allocator->allocate(allocator->context, size ? size : 1);
+}
+
+/**
+ * Allocates zeroed memory for an array.
+ *
+ * @param allocator The allocator, or NULL for the C library's.
+ * @param count The number of elements.
+ * @param size The size of one element.
+ * @return The memory, or NULL.
+ */
+void *memory_allocate_zeroed(const Allocator *allocator, size_t count, size_t size)
+{
+    void *pointer;
+
+    if (!allocator)
+        return calloc(count, size);
+    if (size && count > SIZE_MAX / size)
+        return NULL;
+    if ((pointer = memory_allocate(allocator, count * size)))
+        memset(pointer, 0, count * size);
+    return pointer;
+}
+
+/**
+ * Resizes memory.
+ *
+ * @param allocator The allocator, or NULL for the C library's.
+ * @param pointer The memory, or NULL.
+ * @param size The new number of bytes.
+ * @return The memory, or NULL if it could not be resized.
+ */
+void *memory_reallocate(const Allocator *allocator, void *pointer, size_t size)
+{
+    if (!allocator)
+        return realloc(pointer, size);
+    return allocator->reallocate(allocator->context, pointer, size ? size : 1);
+}
+
+/**
+ * Releases memory.
+ *
+ * @param allocator The allocator, or NULL for the C library's.
+ * @param pointer The memory, or NULL.
+ */
+void memory_release(const Allocator *allocator, void *pointer)
+{
+    if (!allocator)
+        free(pointer);
+    else if (pointer)
+        allocator->release(allocator->context, pointer);
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <ar.h>
+
+#include "nm.h"
+
+typedef struct ArchiveMember
+{
+    char *name;
+    char *data;
+    size_t size;
+    size_t header_offset;
+} ArchiveMember;
+
+typedef struct Archive
+{
+    char *data;
+    size_t size;
+    char *symbol_index;
+    size_t symbol_index_size;
+    int symbol_index_entry; // 4 for the "/" index, 8 for "/SYM64/"
+    char *long_names;
+    size_t long_names_size;
+    ArchiveMember *members;
+    size_t member_count;
+    Options options;
+    Stats *member_stats; // One entry per member, NULL unless --stats is given
+    const Allocator *allocator; // Allocator of the member table, the one of the archive file
+} Archive;
+
+/**
+ * Checks whether a mapped file starts with the archive magic string.
+ *
+ * @param file The file to check.
+ * @return true if the file is an archive, false otherwise.
+ */
+bool is_archive(File *file)
+{
+    return file->file_size >= SARMAG && !memcmp(file->elf_header, ARMAG, SARMAG);
+}
+
+/**
+ * Parses a space-padded decimal field of an archive member header.
+ *
+ * @param field The field to parse.
+ * @param length The width of the field.
+ * @return The parsed number.
+ */
+size_t archive_decimal(const char *field, size_t length)
+{
+    size_t number = 0;
+
+    for (size_t n = 0; n < length && field[n] >= '0' && field[n] <= '9'; n++)
+        number = number * 10 + (field[n] - '0');
+    return number;
+}
+
+/**
+ * Reads a big-endian integer from the archive symbol index.
+ *
+ * @param data The bytes to read.
+ * @param width The width of the integer, 4 or 8 bytes.
+ * @return The decoded integer.
+ */
+size_t archive_index_number(const char *data, int width)
+{
+    size_t number = 0;
+
+    for (int n = 0; n < width; n++)
+        number = (number << 8) | (unsigned char)data[n];
+    return number;
+}
+
+/**
+ * Resolves the name of an archive member, following GNU long names ("/123")
+ * and BSD inline names ("#1/len"), whose bytes are then skipped in the data.
+ *
+ * @param archive The archive the member belongs to.
+ * @param member The member whose data and size are set; its name is allocated.
+ * @param header The member header.
+ * @return 1 if the name could be resolved, 0 otherwise.
+ */
+int archive_member_name(Archive *archive, ArchiveMember *member, struct ar_hdr *header)
+{
+    const char *name = header->ar_name;
+    size_t length = 0;
+    size_t offset;
+
+    if (name[0] == '/' && name[1] >= '0' && name[1] <= '9')
+    {
+        // GNU long name: an offset into the "//" table, terminated by "/\n"
+        offset = archive_decimal(name + 1, sizeof(header->ar_name) - 1);
+        if (!archive->long_names || offset >= archive->long_names_size)
+            return 0;
+        name = archive->long_names + offset;
+        while (offset + length < archive->long_names_size && name[length] != '/' && name[length] != '\n')
+            length++;
+    }
+    else if (!memcmp(name, "#1/", 3))
+    {
+        // BSD long name: stored right before the member data
+        length = archive_decimal(name + 3, sizeof(header->ar_name) - 3);
+        if (length > member->size)
+            return 0;
+        name = member->data;
+        member->data += length;
+        member->size -= length;
+        while (length && !name[length - 1])
+            length--;
+    }
+    else
+    {
+        // Short name, terminated by '/' (GNU) or by padding spaces (BSD)
+        while (length < sizeof(header->ar_name) && name[length] != '/' && name[length] != ' ')
+            length++;
+    }
+
+    if (!(member->name = memory_allocate(archive->allocator, length + 1)))
+        return 0;
+    memcpy(member->name, name, length);
+    member->name[length] = '\0';
+    return 1;
+}
+
+/**
+ * Releases the member table of an archive.
+ *
+ * @param archive The archive to release.
+ */
+void free_archive(Archive *archive)
+{
+    for (size_t n = 0; n < archive->member_count; n++)
+        memory_release(archive->allocator, archive->members[n].name);
+    memory_release(archive->allocator, archive->members);
+    archive->members = NULL;
+    archive->member_count = 0;
+}
+
+/**
+ * Walks the member headers of a mapped archive in place. The symbol index and
+ * the long name table are recorded, every other member is added to the member
+ * table with a pointer to its data inside the mapping.
+ *
+ * @param archive The archive to fill.
+ * @param file The mapped archive file.
+ * @param name The name of the archive.
+ * @return 1 if the archive is well-formed, 0 otherwise.
+ */
+int read_archive(Archive *archive, File *file, char *name)
+{
+    struct ar_hdr *header;
+    ArchiveMember member;
+    ArchiveMember *members;
+    size_t capacity = 0;
+    size_t offset = SARMAG;
+
+    archive->data = (char *)file->elf_header;
+    archive->size = file->file_size;
+    archive->allocator = file->allocator;
+    while (offset + sizeof(struct ar_hdr) <= archive->size)
+    {
+        header = (struct ar_hdr *)(archive->data + offset);
+        member.header_offset = offset;
+        member.data = archive->data + offset + sizeof(struct ar_hdr);
+        member.size = archive_decimal(header->ar_size, sizeof(header->ar_size));
+        member.name = NULL;
+        if (memcmp(header->ar_fmag, ARFMAG, 2) || member.size > archive->size - offset - sizeof(struct ar_hdr))
+        {
+            free_archive(archive);
+            return file_errors(file->output, ": ", name, ": malformed archive\n");
+        }
+
+        // Members start on even offsets
+        offset += sizeof(struct ar_hdr) + member.size + (member.size & 1);
+
+        if (!memcmp(header->ar_name, "/ ", 2) || !memcmp(header->ar_name, "/SYM64/ ", 8))
+        {
+            archive->symbol_index = member.data;
+            archive->symbol_index_size = member.size;
+            archive->symbol_index_entry = header->ar_name[1] == ' ' ? 4 : 8;
+            continue;
+        }
+        if (!memcmp(header->ar_name, "// ", 3))
+        {
+            archive->long_names = member.data;
+            archive->long_names_size = member.size;
+            continue;
+        }
+
+        // Grow the member table geometrically
+        if (archive->member_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            if (!(members = memory_reallocate(archive->allocator, archive->members, sizeof(ArchiveMember) * capacity)))
+            {
+                free_archive(archive);
+                return 0;
+            }
+            archive->members = members;
+        }
+        if (!archive_member_name(archive, &member, header))
+        {
+            free_archive(archive);
+            return file_errors(file->output, ": ", name, ": malformed archive\n");
+        }
+        archive->members[archive->member_count++] = member;
+    }
+    return 1;
+}
+
+/**
+ * Finds the member whose header starts at the given offset.
+ *
+ * @param archive The archive to search.
+ * @param header_offset The offset of the member header.
+ * @return The member, or NULL if no member starts there.
+ */
+ArchiveMember *find_archive_member(Archive *archive, size_t header_offset)
+{
+    size_t low = 0;
+    size_t high = archive->member_count;
+    size_t middle;
+
+    // Members are recorded in file order, so their offsets are sorted
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (archive->members[middle].header_offset < header_offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < archive->member_count && archive->members[low].header_offset == header_offset)
+        return &archive->members[low];
+    return NULL;
+}
+
+/**
+ * Prints the archive symbol index straight from the armap, in GNU nm's
+ * "symbol in member" layout, without parsing any member.
+ *
+ * @param archive The archive whose index is printed.
+ * @param output The output the index is appended to.
+ */
+void print_archive_index(Archive *archive, Output *output)
+{
+    int width = archive->symbol_index_entry;
+    char *index = archive->symbol_index;
+    char *names;
+    char *end;
+    size_t count;
+    size_t length;
+    ArchiveMember *member;
+
+    if (!index || archive->symbol_index_size < (size_t)width)
+        return;
+    count = archive_index_number(index, width);
+    if (count > (archive->symbol_index_size - width) / width)
+        return;
+    names = index + width + count * width;
+    end = index + archive->symbol_index_size;
+
+    output_write(output, "\nArchive index:\n", 16);
+    for (size_t n = 0; n < count && names < end; n++)
+    {
+        length = strnlen(names, end - names);
+        member = find_archive_member(archive, archive_index_number(index + width + n * width, width));
+        output_write(output, names, length);
+        output_write(output, " in ", 4);
+        output_string(output, member ? member->name : "");
+        output_char(output, '\n');
+        names += length + 1;
+    }
+}
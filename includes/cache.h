@@ -0,0 +1,295 @@
+#pragma once
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "nm.h"
+
+#define CACHE_MAGIC "FTNMCAC1"
+#define CACHE_SUFFIX ".nm"
+#define CACHE_DEFAULT_LIMIT ((uint64_t)256 << 20)
+
+// Everything the formatted output of a file depends on
+typedef struct CacheKey
+{
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+    uint32_t options;     // Output-affecting flags, see cache_key
+    uint32_t name_length; // Length of the file name, 0 when the name is not printed
+} CacheKey;
+
+// Layout of a cache entry: this header, the file name, then the formatted output
+typedef struct CacheHeader
+{
+    char magic[8];
+    CacheKey key;
+    uint64_t payload_size;
+} CacheHeader;
+
+typedef struct CacheEntry
+{
+    char *name;
+    uint64_t size;
+    struct timespec used;
+} CacheEntry;
+
+/**
+ * Parses a cache size limit, a byte count with an optional K, M or G suffix.
+ *
+ * @param string The limit to parse.
+ * @return The limit in bytes, 0 if the string is not a valid limit.
+ */
+uint64_t cache_parse_size(char *string)
+{
+    uint64_t size = 0;
+
+    if (*string < '0' || *string > '9')
+        return 0;
+    while (*string >= '0' && *string <= '9')
+        size = size * 10 + (*string++ - '0');
+    if (*string == 'K' || *string == 'k')
+        size <<= 10;
+    else if (*string == 'M' || *string == 'm')
+        size <<= 20;
+    else if (*string == 'G' || *string == 'g')
+        size <<= 30;
+    else if (*string)
+        return 0;
+    return *string && string[1] ? 0 : size;
+}
+
+/**
+ * Builds the cache key of a file from its identity and the options in effect.
+ *
+ * @param key The key to fill.
+ * @param file_stats The stat of the file.
+ * @param options The options the output is produced with.
+ * @param name The printed file name, or NULL when it is not printed.
+ */
+void cache_key(CacheKey *key, struct stat *file_stats, Options options, char *name)
+{
+    be_zero(key, sizeof(CacheKey));
+    key->device = file_stats->st_dev;
+    key->inode = file_stats->st_ino;
+    key->size = file_stats->st_size;
+    key->mtime_sec = file_stats->st_mtim.tv_sec;
+    key->mtime_nsec = file_stats->st_mtim.tv_nsec;
+    key->options = options.all | options.globals << 1 | options.undefined << 2 | options.reverse << 3 |
+                   options.not_sorted << 4 | options.archive_index << 5 | options.dynamic << 6 |
+                   (options.demangle != NULL) << 7 | options.collate << 8 | options.summary << 9;
+    key->name_length = name ? string_length(name) : 0;
+}
+
+/**
+ * Builds the path of the cache entry of a key: the FNV-1a hash of the key
+ * and the file name, in hexadecimal.
+ *
+ * @param directory The cache directory.
+ * @param key The key of the entry.
+ * @param name The printed file name, or NULL.
+ * @return The malloc'd path, with room for a temporary suffix, or NULL.
+ */
+char *cache_path(char *directory, CacheKey *key, char *name)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t length = string_length(directory);
+    char *path;
+
+    for (size_t n = 0; n < sizeof(CacheKey); n++)
+        hash = (hash ^ ((unsigned char *)key)[n]) * 0x100000001b3ULL;
+    for (uint32_t n = 0; n < key->name_length; n++)
+        hash = (hash ^ (unsigned char)name[n]) * 0x100000001b3ULL;
+
+    if (!(path = malloc(length + 64)))
+        return NULL;
+    memcpy(path, directory, length);
+    path[length++] = '/';
+    for (int shift = 60; shift >= 0; shift -= 4)
+        path[length++] = hex[hash >> shift & 0xf];
+    memcpy(path + length, CACHE_SUFFIX, sizeof(CACHE_SUFFIX));
+    return path;
+}
+
+/**
+ * Serves a file from the cache: maps its entry and appends the stored output.
+ * A hit also refreshes the entry's modification time, which eviction uses as
+ * the last use.
+ *
+ * @param directory The cache directory.
+ * @param key The key of the file.
+ * @param name The printed file name, or NULL.
+ * @param output The output the stored symbols are appended to.
+ * @return 1 on a hit, 0 on a miss.
+ */
+int cache_lookup(char *directory, CacheKey *key, char *name, Output *output)
+{
+    struct stat entry_stats;
+    CacheHeader *header;
+    char *path;
+    int fd;
+    int hit = 0;
+
+    if (!(path = cache_path(directory, key, name)))
+        return 0;
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &entry_stats) || (size_t)entry_stats.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return 0;
+    }
+    header = mmap(0, entry_stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (header == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+
+    // Entries are only trusted when the whole key, name included, matches
+    if (!memcmp(header->magic, CACHE_MAGIC, 8) && !memcmp(&header->key, key, sizeof(CacheKey)) &&
+        header->payload_size == entry_stats.st_size - sizeof(CacheHeader) - key->name_length &&
+        (!key->name_length || !memcmp(header + 1, name, key->name_length)))
+    {
+        output_write(output, (char *)(header + 1) + key->name_length, header->payload_size);
+        futimens(fd, NULL);
+        hit = 1;
+    }
+    munmap(header, entry_stats.st_size);
+    close(fd);
+    return hit;
+}
+
+/**
+ * Stores the output of a file in the cache. The entry is written to a
+ * temporary file and renamed into place, so concurrent readers only ever see
+ * complete entries and concurrent writers of the same key simply race to
+ * install identical content.
+ *
+ * @param directory The cache directory.
+ * @param key The key of the file.
+ * @param name The printed file name, or NULL.
+ * @param payload The formatted output of the file.
+ * @param length The length of the output.
+ */
+void cache_store(char *directory, CacheKey *key, char *name, char *payload, size_t length)
+{
+    CacheHeader header;
+    char *path;
+    char *temporary;
+    size_t path_length;
+    int fd;
+    int written;
+
+    if (!(path = cache_path(directory, key, name)) || !(temporary = malloc(string_length(path) + 32)))
+    {
+        free(path);
+        return;
+    }
+
+    // The temporary name is unique to this thread of this process
+    path_length = string_length(path);
+    memcpy(temporary, path, path_length);
+    memcpy(temporary + path_length, ".tmp", 4);
+    path_length += 4;
+    for (uint64_t id = (uint64_t)getpid() << 32 | (uint32_t)gettid(); id; id >>= 4)
+        temporary[path_length++] = "0123456789abcdef"[id & 0xf];
+    temporary[path_length] = '\0';
+
+    mkdir(directory, 0755);
+    if ((fd = open(temporary, O_WRONLY | O_CREAT | O_EXCL, 0644)) >= 0)
+    {
+        be_zero(&header, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, 8);
+        header.key = *key;
+        header.payload_size = length;
+        written = write_all(fd, (char *)&header, sizeof(header)) && write_all(fd, name, key->name_length) &&
+                  write_all(fd, payload, length);
+        if (close(fd) || !written || rename(temporary, path))
+            unlink(temporary);
+    }
+    free(temporary);
+    free(path);
+}
+
+/**
+ * Orders cache entries from the least to the most recently used.
+ */
+int compare_cache_entries(const void *a, const void *b)
+{
+    const struct timespec *x = &((const CacheEntry *)a)->used;
+    const struct timespec *y = &((const CacheEntry *)b)->used;
+
+    if (x->tv_sec != y->tv_sec)
+        return (x->tv_sec > y->tv_sec) - (x->tv_sec < y->tv_sec);
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/**
+ * Evicts the least recently used entries until the cache fits its size limit.
+ * Entries removed by a concurrent process are simply skipped.
+ *
+ * @param directory The cache directory.
+ * @param limit The maximum total size of the entries, in bytes.
+ */
+void cache_evict(char *directory, uint64_t limit)
+{
+    struct dirent *dirent;
+    struct stat entry_stats;
+    CacheEntry *entries = NULL;
+    CacheEntry *grown;
+    size_t count = 0;
+    size_t capacity = 0;
+    uint64_t total = 0;
+    size_t length;
+    DIR *dir;
+
+    if (!(dir = opendir(directory)))
+        return;
+    while ((dirent = readdir(dir)))
+    {
+        length = string_length(dirent->d_name);
+
+        // Temporary files left behind by an interrupted store are dropped after an hour
+        if (strstr(dirent->d_name, CACHE_SUFFIX ".tmp") &&
+            !fstatat(dirfd(dir), dirent->d_name, &entry_stats, AT_SYMLINK_NOFOLLOW) &&
+            entry_stats.st_mtim.tv_sec + 3600 < time(NULL))
+            unlinkat(dirfd(dir), dirent->d_name, 0);
+        if (length <= sizeof(CACHE_SUFFIX) - 1 ||
+            memcmp(dirent->d_name + length - (sizeof(CACHE_SUFFIX) - 1), CACHE_SUFFIX, sizeof(CACHE_SUFFIX) - 1) ||
+            fstatat(dirfd(dir), dirent->d_name, &entry_stats, AT_SYMLINK_NOFOLLOW) || !S_ISREG(entry_stats.st_mode))
+            continue;
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            if (!(grown = realloc(entries, sizeof(CacheEntry) * capacity)))
+                break;
+            entries = grown;
+        }
+        if (!(entries[count].name = malloc(length + 1)))
+            break;
+        memcpy(entries[count].name, dirent->d_name, length + 1);
+        entries[count].size = entry_stats.st_size;
+        entries[count].used = entry_stats.st_mtim;
+        total += entry_stats.st_size;
+        count++;
+    }
+
+    if (total > limit)
+    {
+        qsort(entries, count, sizeof(CacheEntry), compare_cache_entries);
+        for (size_t n = 0; n < count && total > limit; n++)
+            if (!unlinkat(dirfd(dir), entries[n].name, 0) || errno == ENOENT)
+                total -= entries[n].size;
+    }
+    for (size_t n = 0; n < count; n++)
+        free(entries[n].name);
+    free(entries);
+    closedir(dir);
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "nm.h"
+
+#define DEMANGLE_SHARDS 64
+#define DEMANGLE_PARALLEL_THRESHOLD (1 << 12)
+
+// Demangler with the interface of __cxa_demangle, returning a malloc'd name or NULL
+typedef char *(*Demangler)(const char *mangled, char *buffer, size_t *length, int *status);
+
+typedef struct DemangleEntry
+{
+    char *mangled;   // Owned copy of the name, NULL if the slot is free
+    char *demangled; // NULL when the name does not demangle
+    uint64_t hash;
+} DemangleEntry;
+
+typedef struct DemangleShard
+{
+    pthread_mutex_t lock;
+    DemangleEntry *slots; // Open addressing on the hash
+    size_t mask;          // Number of slots minus one
+    size_t count;
+} DemangleShard;
+
+// Demangled names shared by every file of a run, split in shards that are locked independently
+struct DemangleCache
+{
+    Demangler demangler; // Given by the program, so that only ft_nm links against the C++ runtime
+    DemangleShard shards[DEMANGLE_SHARDS];
+};
+
+typedef struct DemangleRun
+{
+    File *file;
+    DemangleCache *cache;
+    size_t start;
+    size_t end;
+} DemangleRun;
+
+/**
+ * Allocates an empty demangling cache.
+ *
+ * @param demangler The function demangling each name missing from the cache.
+ * @return The cache, or NULL if it could not be allocated.
+ */
+DemangleCache *demangle_cache_init(Demangler demangler)
+{
+    DemangleCache *cache;
+
+    if (!(cache = calloc(1, sizeof(DemangleCache))))
+        return NULL;
+    cache->demangler = demangler;
+    for (int n = 0; n < DEMANGLE_SHARDS; n++)
+        pthread_mutex_init(&cache->shards[n].lock, NULL);
+    return cache;
+}
+
+/**
+ * Releases a demangling cache and every name it holds.
+ *
+ * @param cache The cache to release, or NULL.
+ */
+void demangle_cache_free(DemangleCache *cache)
+{
+    for (int n = 0; cache && n < DEMANGLE_SHARDS; n++)
+    {
+        for (size_t slot = 0; cache->shards[n].slots && slot <= cache->shards[n].mask; slot++)
+        {
+            free(cache->shards[n].slots[slot].mangled);
+            free(cache->shards[n].slots[slot].demangled);
+        }
+        free(cache->shards[n].slots);
+        pthread_mutex_destroy(&cache->shards[n].lock);
+    }
+    free(cache);
+}
+
+/**
+ * Finds the slot of a name in a shard: the slot holding it, or the free slot
+ * where it belongs. The caller holds the shard lock.
+ *
+ * @param shard The shard to search.
+ * @param name The mangled name.
+ * @param hash The hash of the name.
+ * @return The slot.
+ */
+DemangleEntry *demangle_slot(DemangleShard *shard, char *name, uint64_t hash)
+{
+    size_t slot = hash & shard->mask;
+
+    while (shard->slots[slot].mangled &&
+           (shard->slots[slot].hash != hash || string_compare(shard->slots[slot].mangled, name)))
+        slot = (slot + 1) & shard->mask;
+    return &shard->slots[slot];
+}
+
+/**
+ * Doubles the slot array of a shard, or creates it. The caller holds the shard lock.
+ *
+ * @param shard The shard to grow.
+ * @return 1 if the shard grew, 0 otherwise.
+ */
+int demangle_shard_grow(DemangleShard *shard)
+{
+    DemangleShard grown = *shard;
+    size_t size = shard->slots ? (shard->mask + 1) * 2 : 256;
+
+    if (!(grown.slots = calloc(size, sizeof(DemangleEntry))))
+        return 0;
+    grown.mask = size - 1;
+    for (size_t slot = 0; shard->slots && slot <= shard->mask; slot++)
+        if (shard->slots[slot].mangled)
+            *demangle_slot(&grown, shard->slots[slot].mangled, shard->slots[slot].hash) = shard->slots[slot];
+    free(shard->slots);
+    shard->slots = grown.slots;
+    shard->mask = grown.mask;
+    return 1;
+}
+
+/**
+ * Returns the demangled form of a symbol name. Only names using the C++ ABI
+ * prefix are demangled, as GNU nm does; the runtime demangler would read any
+ * other name as a type. Each name is demangled once per run: the shard lock is
+ * only held to look the name up and to record it, never while demangling, and
+ * when two threads race on a name the first result recorded wins.
+ *
+ * @param cache The shared cache.
+ * @param name The mangled name.
+ * @return The demangled name, valid until the cache is released, or NULL to print the name as is.
+ */
+char *demangle_name(DemangleCache *cache, char *name)
+{
+    uint64_t hash;
+    DemangleShard *shard;
+    DemangleEntry *entry;
+    char *demangled;
+    char *mangled;
+    int status;
+
+    if (name[0] != '_' || name[1] != 'Z')
+        return NULL;
+    hash = name_hash(name);
+    shard = &cache->shards[hash >> 58];
+    pthread_mutex_lock(&shard->lock);
+    if (shard->slots && (entry = demangle_slot(shard, name, hash))->mangled)
+    {
+        demangled = entry->demangled;
+        pthread_mutex_unlock(&shard->lock);
+        return demangled;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    // Names that cannot be recorded are printed mangled rather than leaked
+    demangled = cache->demangler(name, NULL, NULL, &status);
+    if (!(mangled = strdup(name)))
+    {
+        free(demangled);
+        return NULL;
+    }
+    pthread_mutex_lock(&shard->lock);
+    if ((shard->count + 1) * 2 > (shard->slots ? shard->mask + 1 : 0) && !demangle_shard_grow(shard))
+    {
+        pthread_mutex_unlock(&shard->lock);
+        free(mangled);
+        free(demangled);
+        return NULL;
+    }
+    if ((entry = demangle_slot(shard, name, hash))->mangled)
+    {
+        free(mangled);
+        free(demangled);
+    }
+    else
+    {
+        *entry = (DemangleEntry){mangled, demangled, hash};
+        shard->count++;
+    }
+    demangled = entry->demangled;
+    pthread_mutex_unlock(&shard->lock);
+    return demangled;
+}
+
+/**
+ * Thread entry point demangling one range of a file's stored symbols.
+ *
+ * @param argument The DemangleRun to process.
+ * @return NULL.
+ */
+void *demangle_run_thread(void *argument)
+{
+    DemangleRun *run = argument;
+    SymbolTable *symbols = &run->file->symbols;
+
+    for (size_t n = run->start; n < run->end; n++)
+        symbols->demangled[n] = demangle_name(run->cache, get_symbol_name(run->file, n));
+    return NULL;
+}
+
+/**
+ * Demangles the names of a file's stored symbols into symbols.demangled,
+ * splitting large tables across up to `jobs` threads. Sorting keeps using the
+ * mangled names, as GNU nm does.
+ *
+ * @param file The file whose symbols are demangled.
+ * @param cache The shared cache.
+ * @param jobs The threads the demangling may use.
+ * @return 1 on success, 0 if memory ran out.
+ */
+int demangle_symbols(File *file, DemangleCache *cache, int jobs)
+{
+    DemangleRun runs[PARALLEL_MAX_THREADS];
+    size_t count = file->symbols.count;
+    int threads = split_thread_count(count, DEMANGLE_PARALLEL_THRESHOLD);
+
+    if (!(file->symbols.demangled = memory_allocate(file->symbols.allocator, sizeof(char *) * (count + 1))))
+        return 0;
+    if (jobs > 0 && threads > jobs)
+        threads = jobs;
+    for (int n = 0; n < threads; n++)
+        runs[n] = (DemangleRun){file, cache, count * n / threads, count * (n + 1) / threads};
+    run_threads(demangle_run_thread, runs, sizeof(DemangleRun), threads);
+    return 1;
+}
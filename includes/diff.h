@@ -0,0 +1,224 @@
+#pragma once
+
+#include "nm.h"
+
+#define DIFF_SAME 0
+#define DIFF_DIFFERENT 1
+#define DIFF_TROUBLE 2
+
+// The two files of --diff, loaded by one job each
+typedef struct DiffFiles
+{
+    File files[2];
+    char **names;
+    Options options;
+} DiffFiles;
+
+/**
+ * Returns the name of the version a symbol is bound to, so that the versions
+ * of a dynamic symbol are told apart.
+ *
+ * @param file The file containing the symbol.
+ * @param index The index of the symbol.
+ * @return The version name, or an empty string if the symbol has none.
+ */
+char *diff_version_name(File *file, uint32_t index)
+{
+    uint16_t version;
+
+    if (!file->symbols.versions || !file->versions)
+        return "";
+    version = file->symbols.versions[index] & 0x7fff;
+    if (version < 1 || version >= file->version_count || !file->versions[version].name)
+        return "";
+    return file->versions[version].name;
+}
+
+/**
+ * Prints a symbol that is only in one of the files, as an nm line after a
+ * '-' for removed symbols or a '+' for added ones.
+ *
+ * @param file The file holding the symbol.
+ * @param index The index of the symbol.
+ * @param mark '-' or '+'.
+ */
+void print_diff_symbol(File *file, uint32_t index, char mark)
+{
+    output_char(file->output, mark);
+    output_char(file->output, ' ');
+    print_symbol(file, get_symbol(file, index));
+}
+
+/**
+ * Prints the start of a change line, "~ name: ", the name with its version.
+ *
+ * @param file The file holding the new symbol.
+ * @param symbol The new symbol.
+ */
+void print_diff_change(File *file, Symbol symbol)
+{
+    output_write(file->output, "~ ", 2);
+    output_string(file->output, symbol.name);
+    if (symbol.version)
+        print_symbol_version(file, symbol);
+    output_write(file->output, ": ", 2);
+}
+
+/**
+ * Compares a symbol present in both files: its type letter and, when asked,
+ * its value and size.
+ *
+ * @param old The old file.
+ * @param a The index of the symbol in the old file.
+ * @param new The new file.
+ * @param b The index of the symbol in the new file.
+ * @param options The options, diff_values also compares values and sizes.
+ * @return The number of changes printed.
+ */
+size_t diff_symbol_pair(File *old, uint32_t a, File *new, uint32_t b, Options options)
+{
+    Symbol before = get_symbol(old, a);
+    Symbol after = get_symbol(new, b);
+    size_t changes = 0;
+
+    if (before.letter != after.letter)
+    {
+        print_diff_change(new, after);
+        output_write(new->output, "type ", 5);
+        output_char(new->output, before.letter);
+        output_write(new->output, " -> ", 4);
+        output_char(new->output, after.letter);
+        output_char(new->output, '\n');
+        changes++;
+    }
+    if (!options.diff_values)
+        return changes;
+    if (before.value != after.value)
+    {
+        print_diff_change(new, after);
+        output_write(new->output, "value ", 6);
+        output_hex(new->output, before.value, 8 + (!old->file_type) * 8);
+        output_write(new->output, " -> ", 4);
+        output_hex(new->output, after.value, 8 + (!new->file_type) * 8);
+        output_char(new->output, '\n');
+        changes++;
+    }
+    if (old->symbols.sizes[a] != new->symbols.sizes[b])
+    {
+        print_diff_change(new, after);
+        output_write(new->output, "size ", 5);
+        output_decimal(new->output, old->symbols.sizes[a]);
+        output_write(new->output, " -> ", 4);
+        output_decimal(new->output, new->symbols.sizes[b]);
+        output_char(new->output, '\n');
+        changes++;
+    }
+    return changes;
+}
+
+/**
+ * Compares two runs of symbols sharing a name. Symbols are paired by version,
+ * in sorted order among those of the same version, which pairs up the local
+ * symbols that several source files define under one name. Symbols left
+ * without a partner are removed or added.
+ *
+ * @param old The old file.
+ * @param a The indexes of the run in the old file's print order.
+ * @param a_count The length of the old run.
+ * @param new The new file.
+ * @param b The indexes of the run in the new file's print order.
+ * @param b_count The length of the new run.
+ * @param paired Scratch flags, one per symbol of the new run.
+ * @param options The options of the comparison.
+ * @return The number of differences printed.
+ */
+size_t diff_symbol_runs(File *old, uint32_t *a, size_t a_count, File *new, uint32_t *b, size_t b_count,
+                        bool *paired, Options options)
+{
+    size_t differences = 0;
+    size_t first = 0;
+    size_t m;
+
+    // Without versions the first unpaired symbol always matches, keeping long runs linear
+    be_zero(paired, b_count * sizeof(bool));
+    for (size_t n = 0; n < a_count; n++)
+    {
+        while (first < b_count && paired[first])
+            first++;
+        for (m = first; m < b_count; m++)
+            if (!paired[m] && !string_compare(diff_version_name(old, a[n]), diff_version_name(new, b[m])))
+                break;
+        if (m == b_count)
+        {
+            print_diff_symbol(old, a[n], '-');
+            differences++;
+            continue;
+        }
+        paired[m] = true;
+        differences += diff_symbol_pair(old, a[n], new, b[m], options);
+    }
+    for (m = 0; m < b_count; m++)
+    {
+        if (!paired[m])
+        {
+            print_diff_symbol(new, b[m], '+');
+            differences++;
+        }
+    }
+    return differences;
+}
+
+/**
+ * Compares the sorted symbols of two files in a single merge pass over their
+ * print orders. Only the two symbol tables are held in memory, the output is
+ * produced as the merge advances.
+ *
+ * @param old The old file, its symbols sorted by name.
+ * @param new The new file, its symbols sorted by name.
+ * @param options The options of the comparison.
+ * @return The number of differences printed, or SIZE_MAX if memory ran out.
+ */
+size_t diff_symbols(File *old, File *new, Options options)
+{
+    uint32_t *a = old->symbols.order;
+    uint32_t *b = new->symbols.order;
+    size_t i = 0;
+    size_t j = 0;
+    size_t a_end;
+    size_t b_end;
+    size_t differences = 0;
+    bool *paired;
+    int result;
+
+    if (!(paired = malloc(new->symbols.count + 1)))
+        return SIZE_MAX;
+    while (i < old->symbols.count || j < new->symbols.count)
+    {
+        if (i == old->symbols.count)
+            result = 1;
+        else if (j == new->symbols.count)
+            result = -1;
+        else
+            result = string_compare(get_symbol_name(old, a[i]), get_symbol_name(new, b[j]));
+        if (result < 0)
+            print_diff_symbol(old, a[i++], '-');
+        else if (result > 0)
+            print_diff_symbol(new, b[j++], '+');
+        differences += result != 0;
+        if (result)
+            continue;
+
+        // Both files have the name, possibly several times
+        for (a_end = i + 1; a_end < old->symbols.count &&
+                            !string_compare(get_symbol_name(old, a[a_end]), get_symbol_name(old, a[i]));)
+            a_end++;
+        for (b_end = j + 1; b_end < new->symbols.count &&
+                            !string_compare(get_symbol_name(new, b[b_end]), get_symbol_name(new, b[j]));)
+            b_end++;
+        differences += diff_symbol_runs(old, a + i, a_end - i, new, b + j, b_end - j, paired, options);
+        i = a_end;
+        j = b_end;
+    }
+    free(paired);
+    return differences;
+}
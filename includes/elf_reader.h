@@ -0,0 +1,649 @@
+// ELF reader template, specialized at compile time on ELF_BITS (32 or 64) and
+// ELF_BIG_ENDIAN (0 or 1). Every field access goes through ELF_READ, which is
+// the identity for native byte order and a single bswap otherwise, so each
+// specialization gets its own branch-free inner loops.
+// Structures are read in place through the unaligned copies of elf_readers.h,
+// since archive members only start on 2-byte boundaries.
+//
+// This header is included once per specialization by elf_readers.h and
+// deliberately has no include guard.
+
+#if !defined(ELF_BITS) || !defined(ELF_BIG_ENDIAN)
+#error "ELF_BITS and ELF_BIG_ENDIAN must be defined before including elf_reader.h"
+#endif
+
+#define ELF_CONCAT(a, b, c) a##b##c
+#define ELF_EXPAND(a, b, c) ELF_CONCAT(a, b, c)
+
+#if ELF_BIG_ENDIAN
+#define ELF_FUNCTION(name) ELF_EXPAND(name, _, ELF_EXPAND(ELF_BITS, be, ))
+#else
+#define ELF_FUNCTION(name) ELF_EXPAND(name, _, ELF_EXPAND(ELF_BITS, le, ))
+#endif
+
+#define ElfEhdr ELF_EXPAND(UnalignedElf, ELF_BITS, _Ehdr)
+#define ElfShdr ELF_EXPAND(UnalignedElf, ELF_BITS, _Shdr)
+#define ElfSym ELF_EXPAND(UnalignedElf, ELF_BITS, _Sym)
+#define ElfVerdef ELF_EXPAND(UnalignedElf, ELF_BITS, _Verdef)
+#define ElfVerdaux ELF_EXPAND(UnalignedElf, ELF_BITS, _Verdaux)
+#define ElfVerneed ELF_EXPAND(UnalignedElf, ELF_BITS, _Verneed)
+#define ElfVernaux ELF_EXPAND(UnalignedElf, ELF_BITS, _Vernaux)
+#define ElfBloom ELF_EXPAND(UnalignedUint, ELF_BITS, )
+
+#if ELF_BIG_ENDIAN == HOST_BIG_ENDIAN
+#define ELF_READ(field) ((uint64_t)(field))
+#else
+#define ELF_READ(field) BYTE_SWAP(field)
+#endif
+
+/**
+ * Walks the version definitions and requirements of the dynamic symbols.
+ * A first walk only finds the highest version index, a second one, once
+ * file->versions is allocated, records the name of every index.
+ *
+ * @param file The file containing the version sections.
+ * @param verdef The .gnu.version_d section header, or NULL.
+ * @param verneed The .gnu.version_r section header, or NULL.
+ * @return The highest version index seen.
+ */
+size_t ELF_FUNCTION(walk_versions)(File *file, ElfShdr *verdef, ElfShdr *verneed)
+{
+    char *base;
+    size_t size;
+    size_t offset;
+    size_t aux;
+    size_t next;
+    size_t index;
+    size_t name;
+    size_t highest = 0;
+
+    // Definitions: one name per entry, from its first auxiliary entry
+    base = verdef ? (char *)file->elf_header + ELF_READ(verdef->sh_offset) : NULL;
+    size = verdef ? ELF_READ(verdef->sh_size) : 0;
+    offset = 0;
+    for (size_t n = 0; verdef && n < ELF_READ(verdef->sh_info) && offset + sizeof(ElfVerdef) <= size; n++)
+    {
+        ElfVerdef *definition = (ElfVerdef *)(base + offset);
+        index = ELF_READ(definition->vd_ndx) & 0x7fff;
+        aux = offset + ELF_READ(definition->vd_aux);
+        highest = index > highest ? index : highest;
+        if (file->versions && aux + sizeof(ElfVerdaux) <= size &&
+            (name = ELF_READ(((ElfVerdaux *)(base + aux))->vda_name)) < file->string_table_size)
+            file->versions[index] = (Version){file->string_table + name, false,
+                                              ELF_READ(definition->vd_flags) & VER_FLG_BASE};
+        if (!(next = ELF_READ(definition->vd_next)))
+            break;
+        offset += next;
+    }
+
+    // Requirements: one name per auxiliary entry, indexed by vna_other
+    base = verneed ? (char *)file->elf_header + ELF_READ(verneed->sh_offset) : NULL;
+    size = verneed ? ELF_READ(verneed->sh_size) : 0;
+    offset = 0;
+    for (size_t n = 0; verneed && n < ELF_READ(verneed->sh_info) && offset + sizeof(ElfVerneed) <= size; n++)
+    {
+        ElfVerneed *requirement = (ElfVerneed *)(base + offset);
+        aux = offset + ELF_READ(requirement->vn_aux);
+        for (size_t m = 0; m < ELF_READ(requirement->vn_cnt) && aux + sizeof(ElfVernaux) <= size; m++)
+        {
+            ElfVernaux *auxiliary = (ElfVernaux *)(base + aux);
+            index = ELF_READ(auxiliary->vna_other) & 0x7fff;
+            highest = index > highest ? index : highest;
+            if (file->versions && (name = ELF_READ(auxiliary->vna_name)) < file->string_table_size)
+                file->versions[index] = (Version){file->string_table + name, true, false};
+            if (!(next = ELF_READ(auxiliary->vna_next)))
+                break;
+            aux += next;
+        }
+        if (!(next = ELF_READ(requirement->vn_next)))
+            break;
+        offset += next;
+    }
+    return highest;
+}
+
+/**
+ * Locates the version and hash sections attached to the dynamic symbol table
+ * and decodes the version names once. Sections that are missing, out of
+ * range or not linked to the dynamic symbols are ignored.
+ *
+ * @param file The file being checked.
+ * @param symbol_index The section header index of .dynsym.
+ * @return 1 on success, 0 if the version table could not be allocated.
+ */
+int ELF_FUNCTION(read_dynamic_tables)(File *file, size_t symbol_index)
+{
+    ElfShdr *sectionHeader = (ElfShdr *)file->section_header;
+    ElfShdr *verdef = NULL;
+    ElfShdr *verneed = NULL;
+    size_t string_index = ELF_READ(sectionHeader[symbol_index].sh_link);
+    size_t link;
+    uint32_t type;
+    void *data;
+    size_t size;
+
+    for (size_t n = 1; n < file->section_count; n++)
+    {
+        type = ELF_READ(sectionHeader[n].sh_type);
+        link = ELF_READ(sectionHeader[n].sh_link);
+        size = ELF_READ(sectionHeader[n].sh_size);
+        if (!file_range_valid(file, ELF_READ(sectionHeader[n].sh_offset), size))
+            continue;
+        data = (char *)file->elf_header + ELF_READ(sectionHeader[n].sh_offset);
+        if (type == SHT_GNU_versym && link == symbol_index && size >= file->symbol_count * sizeof(uint16_t))
+            file->version_table = data;
+        else if (type == SHT_GNU_verdef && link == string_index)
+            verdef = &sectionHeader[n];
+        else if (type == SHT_GNU_verneed && link == string_index)
+            verneed = &sectionHeader[n];
+        else if (type == SHT_GNU_HASH && link == symbol_index)
+        {
+            file->gnu_hash = data;
+            file->gnu_hash_size = size;
+        }
+        else if (type == SHT_HASH && link == symbol_index)
+        {
+            file->sysv_hash = data;
+            file->sysv_hash_size = size;
+        }
+    }
+
+    // Versions are only printed when the symbols have both entries and names
+    if (!file->version_table || (!verdef && !verneed))
+    {
+        file->version_table = NULL;
+        return 1;
+    }
+    file->version_count = ELF_FUNCTION(walk_versions)(file, verdef, verneed) + 1;
+    if (!(file->versions = memory_allocate_zeroed(file->allocator, file->version_count, sizeof(Version))))
+        return 0;
+    ELF_FUNCTION(walk_versions)(file, verdef, verneed);
+    return 1;
+}
+
+/**
+ * Locates the section header table of an ELF image.
+ *
+ * @param file The image, at least its header readable.
+ * @param range Receives the byte range of the table.
+ * @return 1 if the table lies inside the file, 0 if the headers are malformed.
+ */
+int ELF_FUNCTION(section_table)(File *file, MapRange *range)
+{
+    ElfEhdr *elfHeader = (ElfEhdr *)file->elf_header;
+    size_t sectionCount = ELF_READ(elfHeader->e_shnum);
+
+    // Malformed headers are left to check_file_data
+    if (!sectionCount || ELF_READ(elfHeader->e_shentsize) != sizeof(ElfShdr) ||
+        !file_range_valid(file, ELF_READ(elfHeader->e_shoff), sectionCount * sizeof(ElfShdr)))
+        return 0;
+    *range = (MapRange){ELF_READ(elfHeader->e_shoff), ELF_READ(elfHeader->e_shoff) + sectionCount * sizeof(ElfShdr),
+                        true};
+    return 1;
+}
+
+/**
+ * Collects the ranges of the sections the readers use: the section name
+ * table, the symbol, string, version and hash tables, and whatever section a
+ * symbol table names as its strings. Code, data, relocation and debug
+ * sections are left out.
+ *
+ * @param file The image, its section header table readable and checked by section_table.
+ * @param ranges Receives the ranges, room for two per section.
+ * @return The number of ranges.
+ */
+size_t ELF_FUNCTION(table_ranges)(File *file, MapRange *ranges)
+{
+    ElfEhdr *elfHeader = (ElfEhdr *)file->elf_header;
+    ElfShdr *sectionHeader = (ElfShdr *)((char *)file->elf_header + ELF_READ(elfHeader->e_shoff));
+    size_t sectionCount = ELF_READ(elfHeader->e_shnum);
+    size_t stringIndex = ELF_READ(elfHeader->e_shstrndx);
+    size_t count = 0;
+    size_t link;
+    uint32_t type;
+
+    for (size_t n = 0; n < sectionCount; n++)
+    {
+        type = ELF_READ(sectionHeader[n].sh_type);
+        link = ELF_READ(sectionHeader[n].sh_link);
+        if (type != SHT_NOBITS && (n == stringIndex || type == SHT_SYMTAB || type == SHT_DYNSYM ||
+                                   type == SHT_STRTAB || type == SHT_GNU_versym || type == SHT_GNU_verdef ||
+                                   type == SHT_GNU_verneed || type == SHT_GNU_HASH || type == SHT_HASH) &&
+            file_range_valid(file, ELF_READ(sectionHeader[n].sh_offset), ELF_READ(sectionHeader[n].sh_size)))
+            ranges[count++] = (MapRange){ELF_READ(sectionHeader[n].sh_offset),
+                                         ELF_READ(sectionHeader[n].sh_offset) + ELF_READ(sectionHeader[n].sh_size),
+                                         type == SHT_SYMTAB || type == SHT_DYNSYM};
+
+        // The string table of a symbol table is kept whatever its type
+        if ((type == SHT_SYMTAB || type == SHT_DYNSYM) && link < sectionCount &&
+            file_range_valid(file, ELF_READ(sectionHeader[link].sh_offset), ELF_READ(sectionHeader[link].sh_size)))
+            ranges[count++] = (MapRange){ELF_READ(sectionHeader[link].sh_offset),
+                                         ELF_READ(sectionHeader[link].sh_offset) + ELF_READ(sectionHeader[link].sh_size),
+                                         false};
+    }
+    return count;
+}
+
+/**
+ * Checks the file data of an ELF file, locates its symbol table (.dynsym with
+ * -D), string tables and section headers, and decodes the section headers once.
+ * A file without the symbol table is valid, its symbol_table left NULL.
+ *
+ * @param file The file to check.
+ * @param name The name of the file.
+ * @param option The options, -D selects the dynamic symbol table.
+ * @return 1 if the file data is valid, 0 otherwise.
+ */
+int ELF_FUNCTION(check_file_data)(File *file, char *name, Options option)
+{
+    ElfEhdr *elfHeader;
+    ElfShdr *sectionHeader;
+    ElfShdr *symbolSection = NULL;
+    size_t sectionCount;
+    size_t stringIndex;
+    size_t link;
+
+    // Check that the header, then the section header table, fit in the file;
+    // a 32-bit header is all get_elf_type requires, whatever the class
+    elfHeader = (ElfEhdr *)file->elf_header;
+    if (file->file_size < sizeof(ElfEhdr))
+        return file_errors(file->output, ": ", name, ": File format not recognized\n");
+    sectionCount = ELF_READ(elfHeader->e_shnum);
+    stringIndex = ELF_READ(elfHeader->e_shstrndx);
+    if (!sectionCount || stringIndex >= sectionCount ||
+        ELF_READ(elfHeader->e_shentsize) != sizeof(ElfShdr) ||
+        !file_range_valid(file, ELF_READ(elfHeader->e_shoff), sectionCount * sizeof(ElfShdr)))
+        return file_errors(file->output, ": ", name, ": File format not recognized\n");
+
+    // Set the section header and section string table pointers
+    file->section_header = (char *)file->elf_header + ELF_READ(elfHeader->e_shoff);
+    sectionHeader = (ElfShdr *)file->section_header;
+    if (!file_range_valid(file, ELF_READ(sectionHeader[stringIndex].sh_offset), ELF_READ(sectionHeader[stringIndex].sh_size)))
+        return file_errors(file->output, ": ", name, ": File format not recognized\n");
+    file->section_string_table = (char *)file->elf_header + ELF_READ(sectionHeader[stringIndex].sh_offset);
+    file->section_string_size = ELF_READ(sectionHeader[stringIndex].sh_size);
+
+    // Check if the symbol table exists
+    for (size_t n = 0; n < sectionCount && !symbolSection; n++)
+    {
+        if (ELF_READ(sectionHeader[n].sh_type) == (option.dynamic ? SHT_DYNSYM : SHT_SYMTAB))
+            symbolSection = &sectionHeader[n];
+    }
+    // Objects without symbols are left without a symbol table, each caller
+    // deciding whether that is an error: a link or a summary just skips them
+    if (!symbolSection)
+        return 1;
+
+    // Set the symbol table and its string table pointers
+    link = ELF_READ(symbolSection->sh_link);
+    if (link >= sectionCount ||
+        !file_range_valid(file, ELF_READ(symbolSection->sh_offset), ELF_READ(symbolSection->sh_size)) ||
+        !file_range_valid(file, ELF_READ(sectionHeader[link].sh_offset), ELF_READ(sectionHeader[link].sh_size)))
+        return file_errors(file->output, ": ", name, ": File format not recognized\n");
+    file->symbol_table = (char *)file->elf_header + ELF_READ(symbolSection->sh_offset);
+    file->string_table = (char *)file->elf_header + ELF_READ(sectionHeader[link].sh_offset);
+    file->string_table_size = ELF_READ(sectionHeader[link].sh_size);
+
+    // Names must not run past the end of their string table
+    if ((file->string_table_size && file->string_table[file->string_table_size - 1]) ||
+        (file->section_string_size && file->section_string_table[file->section_string_size - 1]))
+        return file_errors(file->output, ": ", name, ": File format not recognized\n");
+
+    // Calculate the number of symbols
+    file->symbol_count = ELF_READ(symbolSection->sh_size) / sizeof(ElfSym);
+
+    // Decode the section headers once, symbols only keep their index
+    file->section_count = sectionCount;
+    if (!(file->sections = memory_allocate(file->allocator, sizeof(Section) * file->section_count)))
+        return 0;
+    be_zero(file->sections, sizeof(Section));
+    file->sections[0].name = section_name(file, ELF_READ(sectionHeader[0].sh_name));
+    file->sections[0].letter = classify_section(&file->sections[0]);
+    for (size_t n = 1; n < file->section_count; n++)
+    {
+        file->sections[n].name = section_name(file, ELF_READ(sectionHeader[n].sh_name));
+        file->sections[n].type = ELF_READ(sectionHeader[n].sh_type);
+        file->sections[n].flags = ELF_READ(sectionHeader[n].sh_flags);
+        file->sections[n].letter = classify_section(&file->sections[n]);
+    }
+
+    if (option.dynamic)
+        return ELF_FUNCTION(read_dynamic_tables)(file, symbolSection - sectionHeader);
+    return 1;
+}
+
+/**
+ * Checks whether the symbol table entry passes the filters of the provided options.
+ *
+ * @param file The file containing the symbol.
+ * @param symbol The symbol table entry.
+ * @param option The options specifying which symbols to keep.
+ * @return true if the symbol is kept, false otherwise.
+ */
+bool ELF_FUNCTION(select_symbol)(File *file, ElfSym *symbol, Options option)
+{
+    return select_symbol(file, ELF_READ(symbol->st_name), ELF_READ(symbol->st_shndx), symbol->st_info, option);
+}
+
+/**
+ * Stores a symbol table entry in the file's SymbolTable.
+ *
+ * @param file The file containing the symbol.
+ * @param symbol The symbol table entry.
+ * @param index The position of the symbol in the SymbolTable.
+ */
+void ELF_FUNCTION(store_symbol)(File *file, ElfSym *symbol, size_t index)
+{
+    file->symbols.names[index] = ELF_READ(symbol->st_name);
+    file->symbols.values[index] = ELF_READ(symbol->st_value);
+    file->symbols.sections[index] = ELF_READ(symbol->st_shndx);
+    file->symbols.infos[index] = symbol->st_info;
+    if (file->symbols.sizes)
+        file->symbols.sizes[index] = ELF_READ(symbol->st_size);
+    if (file->symbols.versions)
+        file->symbols.versions[index] = ELF_READ(file->version_table[symbol - (ElfSym *)file->symbol_table]);
+    file->symbols.order[index] = index;
+}
+
+/**
+ * Thread entry point counting the symbols of one range that pass the filters.
+ *
+ * @param argument The ExtractRun to count.
+ * @return NULL.
+ */
+void *ELF_FUNCTION(count_run_thread)(void *argument)
+{
+    ExtractRun *run = argument;
+    ElfSym *symbolTable = (ElfSym *)run->file->symbol_table;
+
+    for (size_t n = run->start; n < run->end; n++)
+        run->count += ELF_FUNCTION(select_symbol)(run->file, &symbolTable[n], *run->option);
+    return NULL;
+}
+
+/**
+ * Thread entry point storing the symbols of one range that pass the filters,
+ * from the run's offset in the SymbolTable on.
+ *
+ * @param argument The ExtractRun to store.
+ * @return NULL.
+ */
+void *ELF_FUNCTION(store_run_thread)(void *argument)
+{
+    ExtractRun *run = argument;
+    ElfSym *symbolTable = (ElfSym *)run->file->symbol_table;
+    size_t index = run->offset;
+
+    for (size_t n = run->start; n < run->end; n++)
+        if (ELF_FUNCTION(select_symbol)(run->file, &symbolTable[n], *run->option))
+            ELF_FUNCTION(store_symbol)(run->file, &symbolTable[n], index++);
+    return NULL;
+}
+
+/**
+ * Retrieves the symbols passing the filters of the provided options into the
+ * file's SymbolTable. A first pass counts them so that only those are
+ * allocated. Large tables are split into ranges decoded on up to option.jobs threads,
+ * each storing its symbols after those of the ranges before it, so the
+ * result is in symbol table order whatever the split.
+ *
+ * @param file The file containing the symbols.
+ * @param option The options specifying which symbols to keep.
+ * @return 1 if the symbol retrieval is successful, 0 otherwise.
+ */
+int ELF_FUNCTION(get_symbols)(File *file, Options option)
+{
+    ExtractRun runs[PARALLEL_MAX_THREADS];
+    size_t symbols = file->symbol_count ? file->symbol_count - 1 : 0;
+    int threads = split_thread_count(symbols, EXTRACT_MIN_RUN);
+    size_t count = 0;
+
+    // -j bounds the threads of one file as it does those of a run
+    if (option.jobs > 0 && threads > option.jobs)
+        threads = option.jobs;
+
+    // Count the symbols to keep in every range, skipping the null symbol
+    for (int n = 0; n < threads; n++)
+        runs[n] = (ExtractRun){file, &option, 1 + symbols * n / threads, 1 + symbols * (n + 1) / threads, 0, 0};
+    run_threads(ELF_FUNCTION(count_run_thread), runs, sizeof(ExtractRun), threads);
+    for (int n = 0; n < threads; n++)
+    {
+        runs[n].offset = count;
+        count += runs[n].count;
+    }
+
+    // Allocate memory for the symbols
+    if (!alloc_symbol_table(&file->symbols, count, option.lookup || option.diff_values, file->version_table,
+                            file->allocator))
+        return 0;
+
+    // Process each symbol that is kept
+    run_threads(ELF_FUNCTION(store_run_thread), runs, sizeof(ExtractRun), threads);
+    return 1;
+}
+
+/**
+ * Marks a symbol if it is kept and its name matches the --find pattern.
+ *
+ * @param file The file containing the symbol.
+ * @param index The index of the symbol in the symbol table.
+ * @param option The options holding the pattern and the filters.
+ * @param matches The bitmap of matching symbols.
+ * @return 1 if the symbol was newly marked, 0 otherwise.
+ */
+size_t ELF_FUNCTION(mark_hash_candidate)(File *file, size_t index, Options option, uint64_t *matches)
+{
+    ElfSym *symbol = (ElfSym *)file->symbol_table + index;
+
+    if (index >= file->symbol_count || matches[index / 64] >> (index % 64) & 1 ||
+        !ELF_FUNCTION(select_symbol)(file, symbol, option) ||
+        !find_name_matches(&option.find, make_symbol(file, ELF_READ(symbol->st_name), 0,
+                                                     ELF_READ(symbol->st_shndx), symbol->st_info).name))
+        return 0;
+    matches[index / 64] |= (uint64_t)1 << (index % 64);
+    return 1;
+}
+
+/**
+ * Finds the dynamic symbols named exactly like a literal --find pattern
+ * through the hash table the dynamic linker uses, .gnu.hash when present and
+ * .hash otherwise, so only the symbols sharing the hash of the name are read.
+ * .gnu.hash leaves out the symbols below its symbol offset, mostly undefined
+ * ones, which are checked one by one.
+ *
+ * @param file The file containing the symbols.
+ * @param option The options holding the pattern and the filters.
+ * @param matches The bitmap of matching symbols.
+ * @return The number of matching symbols, or SIZE_MAX if no usable hash table exists.
+ */
+size_t ELF_FUNCTION(hash_find)(File *file, Options option, uint64_t *matches)
+{
+    UnalignedUint32 *table;
+    UnalignedUint32 *buckets;
+    UnalignedUint32 *chain;
+    ElfBloom *bloom;
+    ElfBloom mask;
+    size_t bucket_count;
+    size_t chain_count;
+    size_t symbol_offset;
+    size_t bloom_size;
+    size_t bloom_shift;
+    size_t symbol_count = file->symbol_count;
+    size_t count = 0;
+    uint32_t hash;
+
+    if ((table = file->gnu_hash) && file->gnu_hash_size >= 4 * sizeof(uint32_t))
+    {
+        bucket_count = ELF_READ(table[0]);
+        symbol_offset = ELF_READ(table[1]);
+        bloom_size = ELF_READ(table[2]);
+        bloom_shift = ELF_READ(table[3]);
+        chain_count = symbol_count > symbol_offset ? symbol_count - symbol_offset : 0;
+        if (bucket_count && bloom_size && !(bloom_size & (bloom_size - 1)) && symbol_offset <= symbol_count &&
+            (file->gnu_hash_size - 4 * sizeof(uint32_t)) / sizeof(uint32_t) >=
+                bloom_size * (sizeof(ElfBloom) / sizeof(uint32_t)) + bucket_count + chain_count)
+        {
+            bloom = (ElfBloom *)(table + 4);
+            buckets = (UnalignedUint32 *)(bloom + bloom_size);
+            chain = buckets + bucket_count;
+            for (size_t n = 1; n < symbol_offset; n++)
+                count += ELF_FUNCTION(mark_hash_candidate)(file, n, option, matches);
+
+            // The Bloom filter rejects most absent names without touching the buckets
+            hash = gnu_hash_name(option.find.pattern);
+            mask = (ElfBloom)1 << (hash % ELF_BITS) | (ElfBloom)1 << ((hash >> bloom_shift) % ELF_BITS);
+            if ((ELF_READ(bloom[(hash / ELF_BITS) & (bloom_size - 1)]) & mask) != mask)
+                return count;
+            for (size_t n = ELF_READ(buckets[hash % bucket_count]); n >= symbol_offset && n < symbol_count; n++)
+            {
+                if ((ELF_READ(chain[n - symbol_offset]) | 1) == (hash | 1))
+                    count += ELF_FUNCTION(mark_hash_candidate)(file, n, option, matches);
+                if (ELF_READ(chain[n - symbol_offset]) & 1)
+                    break;
+            }
+            return count;
+        }
+    }
+
+    if ((table = file->sysv_hash) && file->sysv_hash_size >= 2 * sizeof(uint32_t))
+    {
+        bucket_count = ELF_READ(table[0]);
+        chain_count = ELF_READ(table[1]);
+        if (bucket_count && file->sysv_hash_size / sizeof(uint32_t) - 2 >= bucket_count + chain_count)
+        {
+            buckets = table + 2;
+            chain = buckets + bucket_count;
+            hash = sysv_hash_name(option.find.pattern);
+
+            // Chains are bounded by their length so that a corrupt table cannot loop
+            size_t n = ELF_READ(buckets[hash % bucket_count]);
+            for (size_t steps = 0; n && n < chain_count && steps < chain_count; n = ELF_READ(chain[n]), steps++)
+                count += ELF_FUNCTION(mark_hash_candidate)(file, n, option, matches);
+            return count;
+        }
+    }
+    return SIZE_MAX;
+}
+
+/**
+ * Marks the kept symbols whose name matches the --find pattern. The kept
+ * symbols are indexed by name offset in one pass and the string table is
+ * scanned for the pattern.
+ *
+ * @param file The file containing the symbols.
+ * @param option The options holding the pattern and the filters.
+ * @param matches The bitmap of matching symbols.
+ * @return The number of matching symbols, or SIZE_MAX if the index could not be allocated.
+ */
+size_t ELF_FUNCTION(scan_find)(File *file, Options option, uint64_t *matches)
+{
+    ElfSym *symbolTable = (ElfSym *)file->symbol_table;
+    OffsetMap map = {0};
+    size_t count = 0;
+    size_t name;
+
+    // Index the names of the kept symbols; unnamed ones, shown with their section name, are checked right away
+    if (!offset_map_init(&map, file->symbol_count))
+    {
+        offset_map_free(&map);
+        return SIZE_MAX;
+    }
+    for (size_t n = 1; n < file->symbol_count; n++)
+    {
+        if (!ELF_FUNCTION(select_symbol)(file, &symbolTable[n], option))
+            continue;
+        name = ELF_READ(symbolTable[n].st_name);
+        if (name < file->string_table_size && file->string_table[name])
+            offset_map_insert(&map, name, n);
+        else if (find_name_matches(&option.find, make_symbol(file, name, 0, ELF_READ(symbolTable[n].st_shndx),
+                                                              symbolTable[n].st_info).name))
+        {
+            matches[n / 64] |= (uint64_t)1 << (n % 64);
+            count++;
+        }
+    }
+
+    count += find_matches(file, &map, &option.find, matches);
+    offset_map_free(&map);
+    return count;
+}
+
+/**
+ * Retrieves only the symbols whose name matches the --find pattern, in symbol
+ * table order. With -D, whole-name patterns go through the dynamic hash table
+ * when the file has one, anything else scans the string table.
+ *
+ * @param file The file containing the symbols.
+ * @param option The options holding the pattern and the filters.
+ * @return 1 if the symbol retrieval is successful, 0 otherwise.
+ */
+int ELF_FUNCTION(find_symbols)(File *file, Options option)
+{
+    ElfSym *symbolTable = (ElfSym *)file->symbol_table;
+    uint64_t *matches;
+    uint64_t word;
+    size_t count = SIZE_MAX;
+
+    if (!(matches = memory_allocate_zeroed(file->allocator, file->symbol_count / 64 + 1, sizeof(uint64_t))))
+        return 0;
+    if (option.dynamic && option.find.form == FIND_LITERAL && option.find.needle_length)
+        count = ELF_FUNCTION(hash_find)(file, option, matches);
+    if ((count == SIZE_MAX && (count = ELF_FUNCTION(scan_find)(file, option, matches)) == SIZE_MAX) ||
+        !alloc_symbol_table(&file->symbols, count, option.lookup || option.diff_values, file->version_table,
+                            file->allocator))
+    {
+        memory_release(file->allocator, matches);
+        return 0;
+    }
+
+    // Store the matches in symbol table order
+    count = 0;
+    for (size_t n = 0; n <= file->symbol_count / 64; n++)
+        for (word = matches[n]; word; word &= word - 1)
+            ELF_FUNCTION(store_symbol)(file, &symbolTable[n * 64 + __builtin_ctzll(word)], count++);
+    memory_release(file->allocator, matches);
+    return 1;
+}
+
+/**
+ * Prints the symbols of an ELF file in symbol table order, decoding each
+ * entry straight from the mapped symbol table without building a SymbolTable.
+ *
+ * @param file The file containing the symbols.
+ * @param option The options specifying which symbols to print.
+ */
+void ELF_FUNCTION(stream_symbols)(File *file, Options option)
+{
+    ElfSym *symbol;
+    Symbol decoded;
+    char *demangled;
+
+    for (size_t n = 1; n < file->symbol_count; n++)
+    {
+        symbol = &((ElfSym *)file->symbol_table)[n];
+        if (!ELF_FUNCTION(select_symbol)(file, symbol, option))
+            continue;
+        decoded = make_symbol(file, ELF_READ(symbol->st_name), ELF_READ(symbol->st_value),
+                              ELF_READ(symbol->st_shndx), symbol->st_info);
+        if (file->version_table)
+            decoded.version = ELF_READ(file->version_table[n]);
+        if (option.demangle && (demangled = demangle_name(option.demangle, decoded.name)))
+            decoded.name = demangled;
+        print_symbol(file, decoded);
+    }
+}
+
+#undef ELF_READ
+#undef ElfSym
+#undef ElfVerdef
+#undef ElfVerdaux
+#undef ElfVerneed
+#undef ElfVernaux
+#undef ElfBloom
+#undef ElfShdr
+#undef ElfEhdr
+#undef ELF_FUNCTION
+#undef ELF_EXPAND
+#undef ELF_CONCAT
+#undef ELF_BIG_ENDIAN
+#undef ELF_BITS
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "nm.h"
+#include "find.h"
+#include "demangle.h"
+#include "mapping.h"
+
+#define HOST_BIG_ENDIAN (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+
+// Swaps the byte order of a field of any width, resolved at compile time from its size
+#define BYTE_SWAP(field)                                               \
+    (sizeof(field) == 1 ? (uint64_t)(field)                                  \
+     : sizeof(field) == 2 ? (uint64_t)__builtin_bswap16((uint16_t)(field))   \
+     : sizeof(field) == 4 ? (uint64_t)__builtin_bswap32((uint32_t)(field))   \
+                          : (uint64_t)__builtin_bswap64((uint64_t)(field)))
+
+/**
+ * Checks that a byte range lies entirely inside the file.
+ *
+ * @param file The file the range belongs to.
+ * @param offset The offset of the range.
+ * @param size The size of the range.
+ * @return true if the range is inside the file, false otherwise.
+ */
+bool file_range_valid(File *file, uint64_t offset, uint64_t size)
+{
+    return offset <= file->file_size && size <= file->file_size - offset;
+}
+
+/**
+ * Returns the name of a section, or an empty string if its offset is out of range.
+ *
+ * @param file The file containing the section.
+ * @param offset The offset of the name in the section string table.
+ * @return The name of the section.
+ */
+char *section_name(File *file, uint64_t offset)
+{
+    return offset < file->section_string_size ? &file->section_string_table[offset] : "";
+}
+
+// Copies of the ELF structures without alignment requirement, the types the readers see
+typedef Elf32_Ehdr UnalignedElf32_Ehdr __attribute__((aligned(1)));
+typedef Elf32_Shdr UnalignedElf32_Shdr __attribute__((aligned(1)));
+typedef Elf32_Sym UnalignedElf32_Sym __attribute__((aligned(1)));
+typedef Elf32_Verdef UnalignedElf32_Verdef __attribute__((aligned(1)));
+typedef Elf32_Verdaux UnalignedElf32_Verdaux __attribute__((aligned(1)));
+typedef Elf32_Verneed UnalignedElf32_Verneed __attribute__((aligned(1)));
+typedef Elf32_Vernaux UnalignedElf32_Vernaux __attribute__((aligned(1)));
+typedef Elf64_Ehdr UnalignedElf64_Ehdr __attribute__((aligned(1)));
+typedef Elf64_Shdr UnalignedElf64_Shdr __attribute__((aligned(1)));
+typedef Elf64_Sym UnalignedElf64_Sym __attribute__((aligned(1)));
+typedef Elf64_Verdef UnalignedElf64_Verdef __attribute__((aligned(1)));
+typedef Elf64_Verdaux UnalignedElf64_Verdaux __attribute__((aligned(1)));
+typedef Elf64_Verneed UnalignedElf64_Verneed __attribute__((aligned(1)));
+typedef Elf64_Vernaux UnalignedElf64_Vernaux __attribute__((aligned(1)));
+
+#define ELF_BITS 32
+#define ELF_BIG_ENDIAN 0
+#include "elf_reader.h"
+
+#define ELF_BITS 32
+#define ELF_BIG_ENDIAN 1
+#include "elf_reader.h"
+
+#define ELF_BITS 64
+#define ELF_BIG_ENDIAN 0
+#include "elf_reader.h"
+
+#define ELF_BITS 64
+#define ELF_BIG_ENDIAN 1
+#include "elf_reader.h"
+
+// Readers indexed by [file_type][big endian]
+const ElfReader elf_readers[2][2] = {
+    [ELF64] = {
+        {check_file_data_64le, get_symbols_64le, stream_symbols_64le, find_symbols_64le, section_table_64le,
+         table_ranges_64le},
+        {check_file_data_64be, get_symbols_64be, stream_symbols_64be, find_symbols_64be, section_table_64be,
+         table_ranges_64be},
+    },
+    [ELF32] = {
+        {check_file_data_32le, get_symbols_32le, stream_symbols_32le, find_symbols_32le, section_table_32le,
+         table_ranges_32le},
+        {check_file_data_32be, get_symbols_32be, stream_symbols_32be, find_symbols_32be, section_table_32be,
+         table_ranges_32be},
+    },
+};
+
+/**
+ * Selects the reader of an ELF header from its magic number, class and byte order.
+ *
+ * @param header The first bytes of the file, at least EI_NIDENT of them.
+ * @return The reader, or NULL if the header is not one of a supported ELF file.
+ */
+const ElfReader *select_elf_reader(const unsigned char *header)
+{
+    if (memcmp(header, ELFMAG, SELFMAG) || (header[EI_CLASS] != ELFCLASS32 && header[EI_CLASS] != ELFCLASS64) ||
+        (header[EI_DATA] != ELFDATA2LSB && header[EI_DATA] != ELFDATA2MSB))
+        return NULL;
+    return &elf_readers[header[EI_CLASS] == ELFCLASS32 ? ELF32 : ELF64][header[EI_DATA] == ELFDATA2MSB];
+}
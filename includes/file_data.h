@@ -0,0 +1,131 @@
+#pragma once
+
+#include "nm.h"
+#include "elf_readers.h"
+#include "archive.h"
+#include "prefetch.h"
+#include "stream.h"
+
+/**
+ * Checks the magic number of a mapped ELF image and selects the reader for its class and byte order.
+ *
+ * @param file The File structure holding the mapped image.
+ * @param name The name of the file.
+ * @return 1 if the image is an ELF file, 0 otherwise.
+ */
+int get_elf_type(File *file, char *name)
+{
+    unsigned char *identity = file->elf_header;
+
+    // Check the magic number to determine the file type and byte order, byte
+    // by byte as the image of an archive member is not aligned
+    if (file->file_size < sizeof(Elf32_Ehdr) || !(file->reader = select_elf_reader(identity)))
+        return file_errors(file->output, ": ", name, ": File format not recognized\n");
+    file->file_type = identity[EI_CLASS] == ELFCLASS32 ? ELF32 : ELF64;
+
+    return 1;
+}
+
+/**
+ * Maps only the tables of a large ELF file. The whole size of the file is
+ * reserved without access, then the header page and the ranges the readers
+ * use are mapped at their own offsets, so every pointer computed from the
+ * start of the file stays valid while the code and debug sections are never read.
+ *
+ * @param file The file, its size already set.
+ * @param fd The open descriptor of the file.
+ * @return The number of bytes mapped, or 0 if the file has to be mapped whole.
+ */
+size_t map_sparse(File *file, int fd)
+{
+    size_t mapped = sysconf(_SC_PAGESIZE);
+    const ElfReader *reader;
+
+    if (file->file_size < SPARSE_MAP_MIN || !(file->elf_header = map_reserve(file, fd)))
+        return 0;
+    if (!(reader = select_elf_reader(file->elf_header)) || !map_tables(file, fd, reader, &mapped))
+    {
+        munmap(file->elf_header, file->file_size);
+        file->elf_header = NULL;
+        return 0;
+    }
+    return mapped;
+}
+
+/**
+ * Retrieves file data for a given file. Regular files are mapped, pipes and
+ * sockets, "-" naming the standard input, are read as they stream in.
+ *
+ * @param file The File structure to store the file data.
+ * @param name The name of the file.
+ * @param opened The descriptor and stat of the file prefetched in a batch, or NULL to open it here.
+ * @return 1 if the file data retrieval is successful, 0 otherwise.
+ */
+int get_file_data(File *file, char *name, OpenedFile *opened)
+{
+    struct stat file_stats;
+    size_t mapped;
+    bool standard_input = !string_compare(name, "-");
+    bool streamed;
+
+    // Open the file, the standard input is duplicated so that closing it keeps descriptor 0 taken
+    file->file_descriptor = opened ? opened->fd : standard_input ? dup(STDIN_FILENO) : open(name, O_RDONLY);
+    if (file->file_descriptor <= 0)
+        return file_errors(file->output, ": '", name, ":' No such file\n");
+
+    // Get file stats
+    if (opened && opened->stated)
+        file_stats = opened->stats;
+    else if (fstat(file->file_descriptor, &file_stats))
+    {
+        close(file->file_descriptor);
+        return file_errors(file->output, ": '", name, ":' No such file\n");
+    }
+
+    // Check if the file is a regular file or a stream
+    streamed = S_ISFIFO(file_stats.st_mode) || S_ISSOCK(file_stats.st_mode) ||
+               (standard_input && S_ISCHR(file_stats.st_mode));
+    if (!streamed && !S_ISREG(file_stats.st_mode))
+    {
+        close(file->file_descriptor);
+        return file_errors(file->output, ": Warning: '", name, "' is not an ordinary file\n");
+    }
+
+    // Read a stream keeping only its tables, map a file: only the tables of a large ELF file, anything else whole
+    if (streamed)
+    {
+        if (!read_stream(file, file->file_descriptor, &mapped))
+            file->elf_header = MAP_FAILED;
+    }
+    else
+    {
+        file->file_size = file_stats.st_size;
+        if (!(mapped = map_sparse(file, file->file_descriptor)))
+        {
+            mapped = file->file_size;
+            file->elf_header = mmap(0, file->file_size, PROT_READ, MAP_PRIVATE, file->file_descriptor, 0);
+        }
+    }
+    if (file->stats && file->elf_header != MAP_FAILED)
+    {
+        file->stats->bytes_mapped += mapped;
+        file->stats->pages_mapped += page_count(mapped);
+        file->stats->file_pages += page_count(file->file_size);
+    }
+
+    // Close the file descriptor
+    close(file->file_descriptor);
+    if (file->elf_header == MAP_FAILED)
+    {
+        file->elf_header = NULL;
+        return 0;
+    }
+
+    // Archives are walked member by member, anything else has to be an ELF file
+    if (is_archive(file))
+    {
+        file->file_type = ARCHIVE;
+        return 1;
+    }
+    return get_elf_type(file, name);
+}
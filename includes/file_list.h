@@ -0,0 +1,89 @@
+#pragma once
+
+#include <errno.h>
+
+#include "nm.h"
+
+/**
+ * Reads the whole content of a descriptor into a memory output.
+ *
+ * @param fd The descriptor to read.
+ * @param input The initialized memory output receiving the content.
+ * @return 1 if everything was read, 0 otherwise.
+ */
+int read_whole_input(int fd, Output *input)
+{
+    ssize_t got;
+
+    do
+    {
+        if (!output_reserve(input, OUTPUT_MEMORY_SIZE))
+            return 0;
+        got = read(fd, input->buffer + input->length, input->capacity - input->length);
+        if (got > 0)
+            input->length += got;
+    } while (got > 0 || (got < 0 && errno == EINTR));
+    return got == 0;
+}
+
+/**
+ * Appends the files named by a file list, one path per line, to the files of
+ * the run. Empty lines are skipped and "-" reads the list from the standard input.
+ *
+ * @param list The path of the list.
+ * @param files The files of the run, a malloc'd array grown in place.
+ * @param file_count The number of files already in the array.
+ * @param output The output an unreadable list is reported to.
+ * @return The number of files appended, or -1 if the list could not be read.
+ */
+int read_file_list(char *list, char ***files, int file_count, Output *output)
+{
+    Output input;
+    char **grown;
+    char *line;
+    char *end;
+    size_t lines = 1;
+    int count = 0;
+    int fd;
+    int result;
+
+    if (!output_init_memory(&input))
+        return -1;
+    fd = string_compare(list, "-") ? open(list, O_RDONLY | O_CLOEXEC) : 0;
+    result = fd >= 0 && read_whole_input(fd, &input);
+    if (fd > 0)
+        close(fd);
+    if (!result)
+    {
+        output_release(&input);
+        file_errors(output, ": ", list, ": No such file\n");
+        return -1;
+    }
+
+    // One slot per line, empty lines included
+    for (line = input.buffer; (line = memchr(line, '\n', input.buffer + input.length - line)); line++)
+        lines++;
+    if (!(grown = realloc(*files, sizeof(char *) * (file_count + lines + 1))))
+    {
+        output_release(&input);
+        return -1;
+    }
+    *files = grown;
+    for (line = input.buffer; line < input.buffer + input.length; line = end + 1)
+    {
+        if (!(end = memchr(line, '\n', input.buffer + input.length - line)))
+            end = input.buffer + input.length;
+        if (end == line)
+            continue;
+        if (!((*files)[file_count + count] = strndup(line, end - line)))
+        {
+            while (count)
+                free((*files)[file_count + --count]);
+            output_release(&input);
+            return -1;
+        }
+        count++;
+    }
+    output_release(&input);
+    return count;
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <fnmatch.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "nm.h"
+
+#define OFFSET_MAP_EMPTY UINT32_MAX
+
+// Symbols of a file indexed by the offset of their name, built in one pass
+// over the symbol table. Symbols sharing a name offset are chained.
+typedef struct OffsetMap
+{
+    size_t mask;       // Number of slots minus one
+    uint32_t *offsets; // Name offset of each slot, OFFSET_MAP_EMPTY if free
+    uint32_t *heads;   // First symbol of each slot
+    uint32_t *next;    // Next symbol with the same name offset, indexed by symbol
+} OffsetMap;
+
+/**
+ * Parses a --find pattern. Patterns without wildcards match whole names,
+ * patterns whose only wildcard is a trailing '*' match name prefixes and
+ * anything else is a glob. The needle is the literal text every match has
+ * to contain: the whole name, the prefix, or the longest literal run of the glob.
+ *
+ * @param find The pattern to fill.
+ * @param pattern The pattern given on the command line.
+ */
+void parse_find_pattern(FindPattern *find, char *pattern)
+{
+    size_t length = string_length(pattern);
+    size_t run;
+    bool bracket = false;
+
+    find->pattern = pattern;
+    find->needle = pattern;
+    find->needle_length = 0;
+    if (!strpbrk(pattern, "*?[\\"))
+    {
+        find->form = FIND_LITERAL;
+        find->needle_length = length;
+        return;
+    }
+    if (length && strchr(pattern, '*') == pattern + length - 1 && !strpbrk(pattern, "?[\\"))
+    {
+        find->form = FIND_PREFIX;
+        find->needle_length = length - 1;
+        return;
+    }
+
+    // Escapes and bracket expressions end the literal runs of a glob
+    find->form = FIND_GLOB;
+    for (size_t n = 0; n < length; n += run ? run : 1)
+    {
+        run = 0;
+        if (bracket || strchr("*?[\\", pattern[n]))
+        {
+            if (pattern[n] == '[')
+                bracket = true;
+            else if (pattern[n] == ']')
+                bracket = false;
+            else if (pattern[n] == '\\' && n + 1 < length)
+                n++;
+            continue;
+        }
+        while (n + run < length && !strchr("*?[\\", pattern[n + run]))
+            run++;
+        if (run > find->needle_length)
+        {
+            find->needle = pattern + n;
+            find->needle_length = run;
+        }
+    }
+}
+
+/**
+ * Checks a single name against a --find pattern, for names that do not come
+ * from the string table.
+ *
+ * @param find The pattern.
+ * @param name The name to check.
+ * @return true if the name matches, false otherwise.
+ */
+bool find_name_matches(FindPattern *find, char *name)
+{
+    if (find->form == FIND_LITERAL)
+        return !string_compare(name, find->pattern);
+    if (find->form == FIND_PREFIX)
+        return !strncmp(name, find->needle, find->needle_length);
+    return !fnmatch(find->pattern, name, 0);
+}
+
+/**
+ * Finds the next occurrence of a needle in a memory region. With SSE2, 16
+ * candidate positions are tested at a time by comparing the first and last
+ * bytes of the needle, and only positions where both match are compared in full.
+ *
+ * @param haystack The region to search.
+ * @param size The size of the region.
+ * @param from The position the search starts at.
+ * @param needle The bytes to find.
+ * @param length The number of bytes to find, at least 1.
+ * @return The position of the next occurrence, or `size` if there is none.
+ */
+size_t find_next(const char *haystack, size_t size, size_t from, const char *needle, size_t length)
+{
+    const char *found;
+
+    if (length > size)
+        return size;
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[length - 1]);
+    unsigned mask;
+
+    for (; from + length - 1 + 16 <= size; from += 16)
+    {
+        mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)(haystack + from))),
+                          _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i *)(haystack + from + length - 1)))));
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+            if (length <= 2 || !memcmp(haystack + from + bit + 1, needle + 1, length - 2))
+                return from + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    if (from > size - length)
+        return size;
+    found = memmem(haystack + from, size - from, needle, length);
+    return found ? (size_t)(found - haystack) : size;
+}
+
+/**
+ * Allocates an empty offset map for a symbol table.
+ *
+ * @param map The map to allocate.
+ * @param symbol_count The number of symbols of the table.
+ * @return 1 if the allocation succeeded, 0 otherwise.
+ */
+int offset_map_init(OffsetMap *map, size_t symbol_count)
+{
+    size_t slots = 16;
+
+    // Keep the load factor at or below one half
+    while (slots < symbol_count * 2)
+        slots *= 2;
+    map->mask = slots - 1;
+    map->offsets = malloc(sizeof(uint32_t) * slots);
+    map->heads = malloc(sizeof(uint32_t) * slots);
+    map->next = malloc(sizeof(uint32_t) * (symbol_count + 1));
+    if (!map->offsets || !map->heads || !map->next)
+        return 0;
+    memset(map->offsets, 0xff, sizeof(uint32_t) * slots);
+    return 1;
+}
+
+/**
+ * Releases the arrays of an offset map.
+ *
+ * @param map The map to release.
+ */
+void offset_map_free(OffsetMap *map)
+{
+    free(map->offsets);
+    free(map->heads);
+    free(map->next);
+    be_zero(map, sizeof(OffsetMap));
+}
+
+/**
+ * Returns the slot of a name offset: the slot holding it, or the free slot
+ * where it belongs.
+ *
+ * @param map The map to search.
+ * @param offset The name offset.
+ * @return The index of the slot.
+ */
+size_t offset_map_slot(OffsetMap *map, uint32_t offset)
+{
+    size_t slot = (offset * 0x9e3779b1u) & map->mask;
+
+    while (map->offsets[slot] != offset && map->offsets[slot] != OFFSET_MAP_EMPTY)
+        slot = (slot + 1) & map->mask;
+    return slot;
+}
+
+/**
+ * Adds a symbol under the offset of its name.
+ *
+ * @param map The map to add to.
+ * @param offset The offset of the symbol name.
+ * @param symbol The index of the symbol in the symbol table.
+ */
+void offset_map_insert(OffsetMap *map, uint32_t offset, uint32_t symbol)
+{
+    size_t slot = offset_map_slot(map, offset);
+
+    map->next[symbol] = map->offsets[slot] == offset ? map->heads[slot] : OFFSET_MAP_EMPTY;
+    map->offsets[slot] = offset;
+    map->heads[slot] = symbol;
+}
+
+/**
+ * Marks the symbols named at an offset that match the pattern.
+ *
+ * @param file The file being searched.
+ * @param map The symbols indexed by name offset.
+ * @param find The pattern.
+ * @param offset The name offset to check.
+ * @param matches The bitmap of matching symbols.
+ * @return The number of newly marked symbols.
+ */
+size_t mark_find_matches(File *file, OffsetMap *map, FindPattern *find, uint32_t offset, uint64_t *matches)
+{
+    size_t slot = offset_map_slot(map, offset);
+    size_t count = 0;
+
+    if (offset >= file->string_table_size || map->offsets[slot] != offset)
+        return 0;
+    if (find->form == FIND_LITERAL && file->string_table[offset + find->needle_length])
+        return 0;
+    if (find->form == FIND_GLOB && fnmatch(find->pattern, file->string_table + offset, 0))
+        return 0;
+    for (uint32_t symbol = map->heads[slot]; symbol != OFFSET_MAP_EMPTY; symbol = map->next[symbol])
+    {
+        count += !(matches[symbol / 64] >> (symbol % 64) & 1);
+        matches[symbol / 64] |= (uint64_t)1 << (symbol % 64);
+    }
+    return count;
+}
+
+/**
+ * Finds the symbols whose name matches the --find pattern by scanning the
+ * string table for the needle. Literal and prefix hits are names starting at
+ * the hit; a glob hit is checked for every name starting between the
+ * beginning of the string holding it and the hit, which also covers names
+ * sharing the tail of a longer string.
+ *
+ * @param file The file to search.
+ * @param map The selected symbols indexed by name offset.
+ * @param find The pattern.
+ * @param matches The bitmap of matching symbols, one bit per symbol table entry.
+ * @return The number of matching symbols.
+ */
+size_t find_matches(File *file, OffsetMap *map, FindPattern *find, uint64_t *matches)
+{
+    size_t count = 0;
+    size_t start;
+    size_t scanned = 0;
+
+    // A glob without any literal text has to be checked against every name
+    if (!find->needle_length)
+    {
+        for (size_t slot = 0; slot <= map->mask; slot++)
+            if (map->offsets[slot] != OFFSET_MAP_EMPTY)
+                count += mark_find_matches(file, map, find, map->offsets[slot], matches);
+        return count;
+    }
+
+    for (size_t hit = 0; (hit = find_next(file->string_table, file->string_table_size, hit, find->needle,
+                                          find->needle_length)) < file->string_table_size;
+         hit++)
+    {
+        if (find->form != FIND_GLOB)
+        {
+            count += mark_find_matches(file, map, find, hit, matches);
+            continue;
+        }
+        for (start = hit; start > scanned && file->string_table[start - 1]; start--)
+            ;
+        for (; start <= hit; start++)
+            count += mark_find_matches(file, map, find, start, matches);
+        scanned = hit + 1;
+    }
+    return count;
+}
+
+/**
+ * Hashes a name the way .gnu.hash does (Bernstein's hash, h * 33 + c).
+ *
+ * @param name The name to hash.
+ * @return The hash of the name.
+ */
+uint32_t gnu_hash_name(const char *name)
+{
+    uint32_t hash = 5381;
+
+    while (*name)
+        hash = hash * 33 + (unsigned char)*name++;
+    return hash;
+}
+
+/**
+ * Hashes a name the way the System V .hash section does.
+ *
+ * @param name The name to hash.
+ * @return The hash of the name.
+ */
+uint32_t sysv_hash_name(const char *name)
+{
+    uint32_t hash = 0;
+    uint32_t high;
+
+    while (*name)
+    {
+        hash = (hash << 4) + (unsigned char)*name++;
+        if ((high = hash & 0xf0000000))
+            hash ^= high >> 24;
+        hash &= ~high;
+    }
+    return hash;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+// Public interface of libftnm, the symbol reader of ft_nm as a library.
+// Every call works on its own handle: handles share no state, so several
+// threads may each use their own at the same time.
+//
+// The library only needs the C library and its threads, not the C++ runtime:
+//     cc -I<ft_nm> prog.c libftnm.a -pthread
+//     cc -I<ft_nm> prog.c -L<ft_nm> -lftnm -pthread
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FTNM_DYNAMIC 0x01   // Read the dynamic symbol table, as -D does
+#define FTNM_ALL 0x02       // Keep debugger-only symbols, as -a does
+#define FTNM_UNDEFINED 0x04 // Keep only undefined symbols, as -u does
+#define FTNM_GLOBALS 0x08   // Keep only external symbols, as -g does
+#define FTNM_SORTED 0x10    // Yield symbols in the order nm prints them instead of symbol table order
+#define FTNM_REVERSE 0x20   // Reverse the sorted order, as -r does
+
+typedef struct Ftnm Ftnm;
+
+// Memory functions used for everything a handle allocates, the C library's when NULL is given
+typedef struct FtnmAllocator
+{
+    void *(*allocate)(void *context, size_t size);
+    void *(*reallocate)(void *context, void *pointer, size_t size);
+    void (*release)(void *context, void *pointer);
+    void *context;
+} FtnmAllocator;
+
+// One symbol, its strings valid until the next call on the handle
+typedef struct FtnmSymbol
+{
+    const char *name;
+    const char *member;  // Archive member holding the symbol, NULL outside archives
+    const char *version; // Version of a dynamic symbol, NULL if it has none
+    uint64_t value;
+    uint64_t size;
+    char type;           // The letter nm prints for the symbol
+    bool hidden;         // The version is not the default one
+} FtnmSymbol;
+
+/**
+ * Opens a file, an ELF object or an archive of them, for reading its symbols.
+ * A file that cannot be read still gets a handle, whose first ftnm_next fails.
+ *
+ * @param path The path of the file, "-" for the standard input.
+ * @param flags FTNM_* flags selecting the symbols and their order.
+ * @param allocator The memory functions of the handle, or NULL for the C library's.
+ * @return The handle, or NULL if it could not be allocated.
+ */
+Ftnm *ftnm_open(const char *path, unsigned flags, const FtnmAllocator *allocator);
+
+/**
+ * Opens an image already in memory, which must outlive the handle.
+ *
+ * @param data The image.
+ * @param size The size of the image.
+ * @param name The name used in error messages.
+ * @param flags FTNM_* flags selecting the symbols and their order.
+ * @param allocator The memory functions of the handle, or NULL for the C library's.
+ * @return The handle, or NULL if it could not be allocated.
+ */
+Ftnm *ftnm_open_memory(const void *data, size_t size, const char *name, unsigned flags,
+                       const FtnmAllocator *allocator);
+
+/**
+ * Yields the next symbol of the file, archive members one after the other.
+ * After an error in an archive member, the next call goes on with the next member.
+ *
+ * @param handle The handle.
+ * @param symbol Receives the symbol.
+ * @return 1 if a symbol is yielded, 0 once every symbol was, -1 on an error.
+ */
+int ftnm_next(Ftnm *handle, FtnmSymbol *symbol);
+
+/**
+ * Returns the message of the last error of a handle.
+ *
+ * @param handle The handle.
+ * @return The message, an empty string if no error happened.
+ */
+const char *ftnm_error(Ftnm *handle);
+
+/**
+ * Releases a handle and everything it holds.
+ *
+ * @param handle The handle, or NULL.
+ */
+void ftnm_close(Ftnm *handle);
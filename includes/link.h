@@ -0,0 +1,564 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "nm.h"
+#include "archive.h"
+
+#define LINK_SHARDS 256
+#define LINK_BLOCK_SIZE ((size_t)64 << 10)
+#define LINK_NONE UINT64_MAX
+
+// What a unit contributes to a symbol
+#define LINK_UNDEFINED 1 // Strong reference, weak references never need a definition
+#define LINK_DEFINED 2   // Strong definition, at most one may exist
+#define LINK_WEAK 3      // Weak or unique definition, or any definition of a shared object
+#define LINK_COMMON 4    // Common symbol, merged with other commons and strong definitions
+
+// Units are the objects of the command line and the members of its
+// archives, numbered file << 32 | member so that ids sort in link order.
+// Member 0 is the file itself, archive members count from 1.
+#define LINK_UNIT(file, member) ((uint64_t)(file) << 32 | (uint64_t)(member))
+
+// One interned name and how the units seen so far resolve it
+typedef struct LinkSymbol
+{
+    char *name;
+    uint64_t hash;
+    uint64_t definers[2]; // First two units defining it strongly, LINK_NONE if fewer
+    uint64_t reference;   // First unit referencing it, LINK_NONE if none
+    uint64_t provider;    // First archive member defining it, LINK_NONE if none
+    bool defined;         // Defined weakly, as a common or by a shared object
+} LinkSymbol;
+
+// One lock-protected part of the table, owning the symbols whose hash selects it
+typedef struct LinkShard
+{
+    pthread_mutex_t lock;
+    LinkSymbol **slots; // Open addressing on the hash, NULL if free
+    size_t mask;        // Number of slots minus one
+    size_t count;
+    char *block;        // Current allocation block, chained through its first word
+    size_t block_left;
+} LinkShard;
+
+// An archive member, only linked in when it defines a symbol still undefined
+typedef struct LinkMember
+{
+    char *name;            // "archive(member)"
+    LinkSymbol **symbols;  // Symbols the member contributes to
+    uint8_t *kinds;        // LINK_* contribution to each of them
+    size_t count;
+    bool included;
+} LinkMember;
+
+typedef struct LinkArchive
+{
+    LinkMember *members;
+    size_t member_count;
+} LinkArchive;
+
+typedef struct LinkTable
+{
+    LinkShard shards[LINK_SHARDS];
+    char **files;
+    LinkArchive *archives; // Indexed by file, empty for objects
+    Options options;
+} LinkTable;
+
+// Context of the jobs collecting the members of one archive
+typedef struct LinkArchiveJobs
+{
+    LinkTable *table;
+    Archive *archive;
+    size_t file;
+} LinkArchiveJobs;
+
+/**
+ * Allocates an empty symbol table shared by the collecting jobs.
+ *
+ * @param files The files of the command line.
+ * @param file_count The number of files.
+ * @param options The options in effect.
+ * @return The table, or NULL if it could not be allocated.
+ */
+LinkTable *link_table_init(char **files, size_t file_count, Options options)
+{
+    LinkTable *table;
+
+    if (!(table = calloc(1, sizeof(LinkTable))) || !(table->archives = calloc(file_count, sizeof(LinkArchive))))
+    {
+        free(table);
+        return NULL;
+    }
+    for (int n = 0; n < LINK_SHARDS; n++)
+        pthread_mutex_init(&table->shards[n].lock, NULL);
+    table->files = files;
+    table->options = options;
+    return table;
+}
+
+/**
+ * Releases a table, its interned names and its archive members.
+ *
+ * @param table The table to release.
+ * @param file_count The number of files.
+ */
+void link_table_free(LinkTable *table, size_t file_count)
+{
+    char *next;
+
+    for (int n = 0; n < LINK_SHARDS; n++)
+    {
+        for (char *block = table->shards[n].block; block; block = next)
+        {
+            memcpy(&next, block, sizeof(char *));
+            free(block);
+        }
+        free(table->shards[n].slots);
+        pthread_mutex_destroy(&table->shards[n].lock);
+    }
+    for (size_t n = 0; n < file_count; n++)
+    {
+        for (size_t m = 0; m < table->archives[n].member_count; m++)
+        {
+            free(table->archives[n].members[m].name);
+            free(table->archives[n].members[m].symbols);
+            free(table->archives[n].members[m].kinds);
+        }
+        free(table->archives[n].members);
+    }
+    free(table->archives);
+    free(table);
+}
+
+/**
+ * Builds the name an archive member is reported with, "archive(member)".
+ *
+ * @param archive The name of the archive.
+ * @param member The name of the member.
+ * @return The malloc'd name, or NULL.
+ */
+char *link_member_name(char *archive, char *member)
+{
+    size_t archive_length = string_length(archive);
+    size_t member_length = string_length(member);
+    char *name;
+
+    if (!(name = malloc(archive_length + member_length + 3)))
+        return NULL;
+    memcpy(name, archive, archive_length);
+    name[archive_length] = '(';
+    memcpy(name + archive_length + 1, member, member_length);
+    memcpy(name + archive_length + 1 + member_length, ")", 2);
+    return name;
+}
+
+/**
+ * Allocates memory that lives as long as the shard, from large blocks.
+ * The caller holds the shard lock.
+ *
+ * @param shard The shard the memory belongs to.
+ * @param size The number of bytes, rounded up to keep pointers aligned.
+ * @return The memory, or NULL if it could not be allocated.
+ */
+void *link_alloc(LinkShard *shard, size_t size)
+{
+    size_t block_size = LINK_BLOCK_SIZE;
+    char *block;
+
+    size = (size + 7) & ~(size_t)7;
+    if (size > shard->block_left)
+    {
+        if (block_size < size + sizeof(char *))
+            block_size = size + sizeof(char *);
+        if (!(block = malloc(block_size)))
+            return NULL;
+        memcpy(block, &shard->block, sizeof(char *));
+        shard->block = block;
+        shard->block_left = block_size - sizeof(char *);
+    }
+    shard->block_left -= size;
+    return shard->block + sizeof(char *) + shard->block_left;
+}
+
+/**
+ * Doubles the slot array of a shard, or creates it. The caller holds the shard lock.
+ *
+ * @param shard The shard to grow.
+ * @return 1 if the shard grew, 0 otherwise.
+ */
+int link_shard_grow(LinkShard *shard)
+{
+    size_t size = shard->slots ? (shard->mask + 1) * 2 : 64;
+    LinkSymbol **slots;
+    size_t slot;
+
+    if (!(slots = calloc(size, sizeof(LinkSymbol *))))
+        return 0;
+    for (size_t n = 0; shard->slots && n <= shard->mask; n++)
+    {
+        if (!shard->slots[n])
+            continue;
+        for (slot = shard->slots[n]->hash & (size - 1); slots[slot]; slot = (slot + 1) & (size - 1))
+            ;
+        slots[slot] = shard->slots[n];
+    }
+    free(shard->slots);
+    shard->slots = slots;
+    shard->mask = size - 1;
+    return 1;
+}
+
+/**
+ * Returns the symbol of a name, interning the name on first sight.
+ * The caller holds the shard lock.
+ *
+ * @param shard The shard selected by the hash.
+ * @param name The name of the symbol.
+ * @param hash The hash of the name.
+ * @return The symbol, or NULL if it could not be allocated.
+ */
+LinkSymbol *link_intern(LinkShard *shard, char *name, uint64_t hash)
+{
+    LinkSymbol *symbol;
+    size_t slot;
+    size_t length;
+
+    // Keep the load factor at or below one half
+    if ((shard->count + 1) * 2 > (shard->slots ? shard->mask + 1 : 0) && !link_shard_grow(shard))
+        return NULL;
+    for (slot = hash & shard->mask; (symbol = shard->slots[slot]); slot = (slot + 1) & shard->mask)
+        if (symbol->hash == hash && !strcmp(symbol->name, name))
+            return symbol;
+
+    length = string_length(name) + 1;
+    if (!(symbol = link_alloc(shard, sizeof(LinkSymbol))) || !(symbol->name = link_alloc(shard, length)))
+        return NULL;
+    memcpy(symbol->name, name, length);
+    symbol->hash = hash;
+    symbol->definers[0] = LINK_NONE;
+    symbol->definers[1] = LINK_NONE;
+    symbol->reference = LINK_NONE;
+    symbol->provider = LINK_NONE;
+    symbol->defined = false;
+    shard->slots[slot] = symbol;
+    shard->count++;
+    return symbol;
+}
+
+/**
+ * Applies the contribution of a linked unit to a symbol. Strong definitions
+ * keep the two lowest unit ids so the report does not depend on which job
+ * finished first.
+ *
+ * @param symbol The symbol.
+ * @param kind The LINK_* contribution.
+ * @param unit The id of the unit.
+ */
+void link_apply(LinkSymbol *symbol, uint8_t kind, uint64_t unit)
+{
+    if (kind == LINK_UNDEFINED)
+        symbol->reference = unit < symbol->reference ? unit : symbol->reference;
+    else if (kind == LINK_DEFINED && unit < symbol->definers[1])
+    {
+        symbol->definers[1] = unit < symbol->definers[0] ? symbol->definers[0] : unit;
+        symbol->definers[0] = unit < symbol->definers[0] ? unit : symbol->definers[0];
+    }
+    else if (kind != LINK_DEFINED)
+        symbol->defined = true;
+}
+
+/**
+ * Checks whether a linked object or shared object defines the symbol.
+ *
+ * @param symbol The symbol.
+ * @return true if the symbol is defined, false otherwise.
+ */
+bool link_resolved(LinkSymbol *symbol)
+{
+    return symbol->defined || symbol->definers[0] != LINK_NONE;
+}
+
+/**
+ * Checks whether a mapped ELF image is a shared object.
+ *
+ * @param file The mapped image.
+ * @return true if the image is a shared object, false otherwise.
+ */
+bool link_shared_object(File *file)
+{
+    return elf_object_type(file) == ET_DYN;
+}
+
+/**
+ * Classifies the contribution of a stored symbol. Shared objects only provide
+ * definitions, and weak undefined references are left out.
+ *
+ * @param file The file holding the symbol.
+ * @param index The index of the symbol in the SymbolTable.
+ * @param shared Whether the file is a shared object.
+ * @return The LINK_* contribution, 0 if the symbol contributes nothing.
+ */
+uint8_t link_kind(File *file, uint32_t index, bool shared)
+{
+    uint8_t bind = file->symbols.infos[index] >> 4;
+    uint16_t shndx = file->symbols.sections[index];
+
+    if (!shndx)
+        return shared || bind == STB_WEAK ? 0 : LINK_UNDEFINED;
+    if (shared || bind != STB_GLOBAL)
+        return LINK_WEAK;
+    return shndx == SHN_COMMON ? LINK_COMMON : LINK_DEFINED;
+}
+
+/**
+ * Feeds the global symbols of one unit into the table. The names are hashed,
+ * the top byte of the hash selecting the shard, and bucketed by shard first,
+ * so each shard is locked once per unit. Objects are linked right away;
+ * archive members only record what they contribute and offer their
+ * definitions, link_resolve decides which ones are linked.
+ *
+ * @param table The shared table.
+ * @param file The unit, with its global symbols stored.
+ * @param unit The id of the unit.
+ * @param member The archive member being collected, or NULL for an object.
+ * @return 1 on success, 0 if memory ran out.
+ */
+int link_collect(LinkTable *table, File *file, uint64_t unit, LinkMember *member)
+{
+    size_t starts[LINK_SHARDS + 1] = {0};
+    bool shared = link_shared_object(file);
+    uint64_t *hashes;
+    uint32_t *order;
+    uint8_t *kinds;
+    LinkShard *shard;
+    LinkSymbol *symbol;
+    size_t count = 0;
+    size_t n;
+    int result = 1;
+
+    hashes = malloc(sizeof(uint64_t) * (file->symbols.count + 1));
+    order = malloc(sizeof(uint32_t) * (file->symbols.count + 1));
+    kinds = malloc(file->symbols.count + 1);
+    if (!hashes || !order || !kinds ||
+        (member && (!(member->symbols = malloc(sizeof(LinkSymbol *) * (file->symbols.count + 1))) ||
+                    !(member->kinds = malloc(file->symbols.count + 1)))))
+    {
+        free(hashes);
+        free(order);
+        free(kinds);
+        return 0;
+    }
+
+    // Bucket the contributing symbols by shard with a counting sort
+    for (uint32_t index = 0; index < file->symbols.count; index++)
+    {
+        if (!(kinds[index] = link_kind(file, index, shared)))
+            continue;
+        hashes[index] = name_hash(get_symbol_name(file, index));
+        starts[(hashes[index] >> 56) + 1]++;
+        count++;
+    }
+    for (n = 1; n <= LINK_SHARDS; n++)
+        starts[n] += starts[n - 1];
+    for (uint32_t index = 0; index < file->symbols.count; index++)
+        if (kinds[index])
+            order[starts[hashes[index] >> 56]++] = index;
+
+    // starts[n] now ends shard n, which begins where shard n - 1 ends
+    for (n = 0; n < LINK_SHARDS && result; n++)
+    {
+        if (starts[n] == (n ? starts[n - 1] : 0))
+            continue;
+        shard = &table->shards[n];
+        pthread_mutex_lock(&shard->lock);
+        for (size_t k = n ? starts[n - 1] : 0; k < starts[n]; k++)
+        {
+            if (!(symbol = link_intern(shard, get_symbol_name(file, order[k]), hashes[order[k]])))
+            {
+                result = 0;
+                break;
+            }
+            if (!member)
+                link_apply(symbol, kinds[order[k]], unit);
+            else
+            {
+                if (kinds[order[k]] != LINK_UNDEFINED && unit < symbol->provider)
+                    symbol->provider = unit;
+                member->symbols[member->count] = symbol;
+                member->kinds[member->count++] = kinds[order[k]];
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    free(hashes);
+    free(order);
+    free(kinds);
+    return result;
+}
+
+/**
+ * Returns the archive member of a unit id.
+ *
+ * @param table The table.
+ * @param unit The id of an archive member.
+ * @return The member.
+ */
+LinkMember *link_member(LinkTable *table, uint64_t unit)
+{
+    return &table->archives[unit >> 32].members[(uint32_t)unit - 1];
+}
+
+/**
+ * Links archive members the way a linker searching every archive repeatedly
+ * would: as long as a referenced symbol is undefined and some member defines
+ * it, the first such member is linked, which may reference further symbols.
+ * Runs once every unit is collected, on the calling thread.
+ *
+ * @param table The table.
+ * @return 1 on success, 0 if memory ran out.
+ */
+int link_resolve(LinkTable *table)
+{
+    LinkSymbol **pending = NULL;
+    LinkSymbol **grown;
+    LinkSymbol *symbol;
+    LinkMember *member;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t total = 0;
+
+    for (int n = 0; n < LINK_SHARDS; n++)
+        total += table->shards[n].count;
+    if (!(pending = malloc(sizeof(LinkSymbol *) * (capacity = total + 1))))
+        return 0;
+    for (int n = 0; n < LINK_SHARDS; n++)
+        for (size_t slot = 0; table->shards[n].slots && slot <= table->shards[n].mask; slot++)
+            if ((symbol = table->shards[n].slots[slot]) && symbol->reference != LINK_NONE)
+                pending[count++] = symbol;
+
+    while (count)
+    {
+        symbol = pending[--count];
+        if (link_resolved(symbol) || symbol->provider == LINK_NONE || link_member(table, symbol->provider)->included)
+            continue;
+        member = link_member(table, symbol->provider);
+        member->included = true;
+        if (count + member->count > capacity)
+        {
+            capacity = (count + member->count) * 2;
+            if (!(grown = realloc(pending, sizeof(LinkSymbol *) * capacity)))
+            {
+                free(pending);
+                return 0;
+            }
+            pending = grown;
+        }
+        for (size_t n = 0; n < member->count; n++)
+        {
+            link_apply(member->symbols[n], member->kinds[n], symbol->provider);
+            if (member->kinds[n] == LINK_UNDEFINED)
+                pending[count++] = member->symbols[n];
+        }
+    }
+    free(pending);
+    return 1;
+}
+
+/**
+ * Appends the name of a unit: the file name, or "archive(member)".
+ *
+ * @param table The table.
+ * @param output The output to append to.
+ * @param unit The id of the unit.
+ */
+void link_unit_name(LinkTable *table, Output *output, uint64_t unit)
+{
+    output_string(output, (uint32_t)unit ? link_member(table, unit)->name : table->files[unit >> 32]);
+}
+
+/**
+ * Checks whether the linker itself defines a symbol when it is referenced:
+ * the GOT and dynamic section anchors, the segment boundaries and the
+ * __start_ and __stop_ symbols of named sections.
+ *
+ * @param name The name of the symbol.
+ * @return true if the linker provides the symbol, false otherwise.
+ */
+bool link_linker_defined(char *name)
+{
+    static char *const provided[] = {
+        "_GLOBAL_OFFSET_TABLE_", "_DYNAMIC", "_PROCEDURE_LINKAGE_TABLE_", "__ehdr_start", "__executable_start",
+        "_etext", "etext", "__etext", "_edata", "edata", "__bss_start", "_end", "end",
+        "__init_array_start", "__init_array_end", "__fini_array_start", "__fini_array_end",
+        "__preinit_array_start", "__preinit_array_end", "__rela_iplt_start", "__rela_iplt_end",
+        "__rel_iplt_start", "__rel_iplt_end", "__GNU_EH_FRAME_HDR", "__TMC_END__", NULL};
+
+    if (!strncmp(name, "__start_", 8) || !strncmp(name, "__stop_", 7))
+        return true;
+    for (int n = 0; provided[n]; n++)
+        if (!string_compare(name, provided[n]))
+            return true;
+    return false;
+}
+
+/**
+ * Orders reported symbols by name.
+ */
+int compare_link_symbols(const void *a, const void *b)
+{
+    return strcmp((*(LinkSymbol *const *)a)->name, (*(LinkSymbol *const *)b)->name);
+}
+
+/**
+ * Prints the symbols that would make the link fail, sorted by name, in the
+ * linker's own wording: references nothing defines, the linker aside, and
+ * symbols defined strongly by more than one linked unit.
+ *
+ * @param table The resolved table.
+ * @param output The output the report is appended to.
+ * @return The number of problems reported, or SIZE_MAX if memory ran out.
+ */
+size_t link_report(LinkTable *table, Output *output)
+{
+    LinkSymbol **problems;
+    LinkSymbol *symbol;
+    size_t count = 0;
+    size_t total = 0;
+
+    for (int n = 0; n < LINK_SHARDS; n++)
+        total += table->shards[n].count;
+    if (!(problems = malloc(sizeof(LinkSymbol *) * (total + 1))))
+        return SIZE_MAX;
+    for (int n = 0; n < LINK_SHARDS; n++)
+        for (size_t slot = 0; table->shards[n].slots && slot <= table->shards[n].mask; slot++)
+            if ((symbol = table->shards[n].slots[slot]) &&
+                ((symbol->reference != LINK_NONE && !link_resolved(symbol) && !link_linker_defined(symbol->name)) ||
+                 symbol->definers[1] != LINK_NONE))
+                problems[count++] = symbol;
+    qsort(problems, count, sizeof(LinkSymbol *), compare_link_symbols);
+
+    for (size_t n = 0; n < count; n++)
+    {
+        symbol = problems[n];
+        if (symbol->definers[1] != LINK_NONE)
+        {
+            link_unit_name(table, output, symbol->definers[1]);
+            output_write(output, ": multiple definition of `", 26);
+            output_string(output, symbol->name);
+            output_write(output, "'; first defined in ", 20);
+            link_unit_name(table, output, symbol->definers[0]);
+            output_char(output, '\n');
+        }
+        else
+        {
+            link_unit_name(table, output, symbol->reference);
+            output_write(output, ": undefined reference to `", 26);
+            output_string(output, symbol->name);
+            output_write(output, "'\n", 2);
+        }
+    }
+    free(problems);
+    return count;
+}
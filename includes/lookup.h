@@ -0,0 +1,400 @@
+#pragma once
+
+#include "nm.h"
+#include "demangle.h"
+
+#define LOOKUP_BATCH 16
+
+// Start addresses of the defined symbols in Eytzinger (BFS) order. The tree
+// is padded to a full one with UINT64_MAX keys so every search takes exactly
+// `depth` branch-free steps.
+typedef struct LookupIndex
+{
+    size_t count;     // Number of real keys
+    size_t size;      // Number of nodes, 2^depth - 1
+    int depth;
+    uint64_t *keys;   // 1-based, keys[0] unused
+    uint32_t *ranks;  // Sorted position of each node's key
+    uint32_t *sorted; // Symbol indexes ordered by address
+    uint64_t *extents; // Bytes covered from each address, 0 when unbounded
+} LookupIndex;
+
+typedef struct LookupEntry
+{
+    uint64_t value;
+    uint64_t extent;
+    uint32_t preference;
+    uint32_t symbol;
+} LookupEntry;
+
+/**
+ * Parses hexadecimal addresses, with an optional 0x prefix, separated by
+ * commas or whitespace, and appends them to the lookup addresses.
+ *
+ * @param options The options holding the addresses.
+ * @param text The text to parse.
+ * @param length The length of the text.
+ * @return 1 if every address was valid, 0 otherwise.
+ */
+int parse_lookup_addresses(Options *options, char *text, size_t length)
+{
+    uint64_t *grown;
+    uint64_t address;
+    size_t digits;
+    size_t end;
+    size_t start;
+    int valid = 1;
+
+    for (size_t n = 0; n < length;)
+    {
+        if (text[n] == ',' || isspace((unsigned char)text[n]))
+        {
+            n++;
+            continue;
+        }
+        end = n;
+        while (end < length && text[end] != ',' && !isspace((unsigned char)text[end]))
+            end++;
+        start = n;
+        if (end - n > 2 && text[n] == '0' && (text[n + 1] == 'x' || text[n + 1] == 'X'))
+            n += 2;
+
+        // Reject anything that is not a hexadecimal number of at most 64 bits
+        address = 0;
+        for (digits = 0; n + digits < end && isxdigit((unsigned char)text[n + digits]); digits++)
+            address = address << 4 | (isdigit((unsigned char)text[n + digits]) ? text[n + digits] - '0'
+                                                                                : (text[n + digits] | 0x20) - 'a' + 10);
+        if (!digits || n + digits != end || digits > 16)
+        {
+            write(2, TOOL_NAME ": invalid address '", sizeof(TOOL_NAME ": invalid address '") - 1);
+            write(2, text + start, end - start);
+            write(2, "'\n", 2);
+            valid = 0;
+            n = end;
+            continue;
+        }
+        n = end;
+
+        // The array grows to the next power of two, from 16 entries
+        if (!options->lookup_count ||
+            (options->lookup_count >= 16 && !(options->lookup_count & (options->lookup_count - 1))))
+        {
+            if (!(grown = realloc(options->lookup_addresses,
+                                  sizeof(uint64_t) * (options->lookup_count ? options->lookup_count * 2 : 16))))
+                return 0;
+            options->lookup_addresses = grown;
+        }
+        options->lookup_addresses[options->lookup_count++] = address;
+    }
+    return valid;
+}
+
+/**
+ * Reads every address from the standard input.
+ *
+ * @param options The options holding the addresses.
+ * @return 1 if the input was read and every address was valid, 0 otherwise.
+ */
+int read_lookup_addresses(Options *options)
+{
+    Output input;
+    ssize_t got;
+    int result;
+
+    if (!output_init_memory(&input))
+        return 0;
+    do
+    {
+        if (!output_reserve(&input, OUTPUT_MEMORY_SIZE))
+            break;
+        got = read(0, input.buffer + input.length, input.capacity - input.length);
+        if (got > 0)
+            input.length += got;
+    } while (got > 0 || (got < 0 && errno == EINTR));
+    result = parse_lookup_addresses(options, input.buffer, input.length);
+    output_release(&input);
+    return result;
+}
+
+/**
+ * Ranks the symbols starting at the same address: sized symbols first, then
+ * globals before weak before local ones, then functions and objects.
+ *
+ * @param size The st_size of the symbol.
+ * @param info The packed bind and type of the symbol.
+ * @return A larger value for the preferred symbol.
+ */
+uint32_t lookup_preference(uint64_t size, uint8_t info)
+{
+    static const uint8_t binds[16] = {[STB_GLOBAL] = 3, [STB_WEAK] = 2, [STB_LOCAL] = 1};
+    uint8_t type = info & 0xf;
+
+    return (size != 0) << 3 | binds[info >> 4] << 1 | (type == STT_FUNC || type == STT_OBJECT);
+}
+
+/**
+ * Sorts lookup entries by address, the preferred symbol first, with a stable
+ * LSD radix sort: one pass on the preference, then one per address byte.
+ * Passes where every entry falls in the same bucket are skipped.
+ *
+ * @param entries The entries to sort, in symbol order.
+ * @param count The number of entries.
+ * @return 1 if the entries were sorted, 0 if the scratch buffer could not be allocated.
+ */
+int sort_lookup_entries(LookupEntry *entries, size_t count)
+{
+    size_t counts[256];
+    size_t position;
+    LookupEntry *buffer;
+    LookupEntry *from = entries;
+    LookupEntry *to;
+    LookupEntry *swap;
+    unsigned digit;
+
+    if (!(buffer = malloc(sizeof(LookupEntry) * (count + 1))))
+        return 0;
+    to = buffer;
+    for (int pass = -1; pass < 8; pass++)
+    {
+        be_zero(counts, sizeof(counts));
+        for (size_t n = 0; n < count; n++)
+            counts[pass < 0 ? 15 - from[n].preference : from[n].value >> (pass * 8) & 0xff]++;
+        digit = pass < 0 ? 15 - from[0].preference : from[0].value >> (pass * 8) & 0xff;
+        if (!count || counts[digit] == count)
+            continue;
+        position = 0;
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            size_t bucket_count = counts[bucket];
+            counts[bucket] = position;
+            position += bucket_count;
+        }
+        for (size_t n = 0; n < count; n++)
+            to[counts[pass < 0 ? 15 - from[n].preference : from[n].value >> (pass * 8) & 0xff]++] = from[n];
+        swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != entries)
+        memcpy(entries, from, sizeof(LookupEntry) * count);
+    free(buffer);
+    return 1;
+}
+
+/**
+ * Fills the Eytzinger layout from the sorted keys with an in-order walk.
+ *
+ * @param index The index being built.
+ * @param entries The sorted entries, one per distinct address.
+ * @param node The node to fill, 1-based.
+ * @param rank The next sorted position to place.
+ * @return The next sorted position after the subtree of `node`.
+ */
+size_t fill_lookup_index(LookupIndex *index, LookupEntry *entries, size_t node, size_t rank)
+{
+    if (node > index->size)
+        return rank;
+    rank = fill_lookup_index(index, entries, node * 2, rank);
+    index->keys[node] = rank < index->count ? entries[rank].value : UINT64_MAX;
+    index->ranks[node] = rank;
+    return fill_lookup_index(index, entries, node * 2 + 1, rank + 1);
+}
+
+/**
+ * Builds the lookup index over the start addresses of the file's symbols.
+ * Only one symbol, the preferred one, is kept per address; it covers the
+ * largest size of the symbols sharing the address, or everything up to the
+ * next address when one of them has no size.
+ *
+ * @param index The index to build.
+ * @param file The file whose SymbolTable holds the defined symbols and their sizes.
+ * @return 1 if the index was built, 0 otherwise.
+ */
+int build_lookup_index(LookupIndex *index, File *file)
+{
+    SymbolTable *symbols = &file->symbols;
+    LookupEntry *entries;
+    size_t count = 0;
+
+    be_zero(index, sizeof(LookupIndex));
+    if (!(entries = malloc(sizeof(LookupEntry) * (symbols->count + 1))))
+        return 0;
+    for (size_t n = 0; n < symbols->count; n++)
+        entries[n] = (LookupEntry){symbols->values[n], symbols->sizes[n],
+                                   lookup_preference(symbols->sizes[n], symbols->infos[n]), n};
+    if (!sort_lookup_entries(entries, symbols->count))
+    {
+        free(entries);
+        return 0;
+    }
+    for (size_t n = 0; n < symbols->count; n++)
+    {
+        if (!count || entries[n].value != entries[count - 1].value)
+            entries[count++] = entries[n];
+        else if (!entries[n].extent || (entries[count - 1].extent && entries[n].extent > entries[count - 1].extent))
+            entries[count - 1].extent = entries[n].extent;
+    }
+
+    // Pad the tree to a full one so that every search has the same depth
+    index->count = count;
+    while (((size_t)1 << index->depth) - 1 < count)
+        index->depth++;
+    index->size = ((size_t)1 << index->depth) - 1;
+    index->keys = aligned_alloc(64, ((index->size + 1) * sizeof(uint64_t) + 63) & ~(size_t)63);
+    index->ranks = malloc(sizeof(uint32_t) * (index->size + 1));
+    index->sorted = malloc(sizeof(uint32_t) * (count + 1));
+    index->extents = malloc(sizeof(uint64_t) * (count + 1));
+    if (!index->keys || !index->ranks || !index->sorted || !index->extents)
+    {
+        free(entries);
+        return 0;
+    }
+    fill_lookup_index(index, entries, 1, 0);
+    for (size_t n = 0; n < count; n++)
+    {
+        index->sorted[n] = entries[n].symbol;
+        index->extents[n] = entries[n].extent;
+    }
+    free(entries);
+    return 1;
+}
+
+/**
+ * Releases the arrays of a lookup index.
+ *
+ * @param index The index to release.
+ */
+void free_lookup_index(LookupIndex *index)
+{
+    free(index->keys);
+    free(index->ranks);
+    free(index->sorted);
+    free(index->extents);
+    be_zero(index, sizeof(LookupIndex));
+}
+
+/**
+ * Finds, for a batch of addresses, the sorted position of the last symbol
+ * starting at or below each of them. The searches of a batch advance in
+ * lockstep, so the cache misses of one overlap with those of the others.
+ *
+ * @param index The lookup index.
+ * @param addresses The addresses to resolve.
+ * @param count The number of addresses.
+ * @param results The sorted position found for each address, or `index->count` if none.
+ */
+void search_lookup_index(LookupIndex *index, uint64_t *addresses, size_t count, size_t *results)
+{
+    size_t nodes[LOOKUP_BATCH];
+    size_t width;
+    size_t rank;
+
+    for (size_t base = 0; base < count; base += LOOKUP_BATCH)
+    {
+        width = count - base < LOOKUP_BATCH ? count - base : LOOKUP_BATCH;
+        for (size_t n = 0; n < width; n++)
+            nodes[n] = 1;
+        for (int level = 0; level < index->depth; level++)
+        {
+            for (size_t n = 0; n < width; n++)
+            {
+                __builtin_prefetch(index->keys + nodes[n] * 8);
+                nodes[n] = nodes[n] * 2 + (index->keys[nodes[n]] <= addresses[base + n]);
+            }
+        }
+
+        // Climb back to the first key above the address, its predecessor is the answer
+        for (size_t n = 0; n < width; n++)
+        {
+            nodes[n] >>= __builtin_ctzll(~(unsigned long long)nodes[n]) + 1;
+            rank = nodes[n] ? index->ranks[nodes[n]] : index->count;
+            if (rank > index->count)
+                rank = index->count;
+            results[base + n] = rank ? rank - 1 : index->count;
+        }
+    }
+}
+
+/**
+ * Appends a number in hexadecimal format, without padding.
+ *
+ * @param output The output to append to.
+ * @param number The number to format.
+ */
+void output_hex_minimal(Output *output, uint64_t number)
+{
+    output_hex(output, number, number ? (67 - __builtin_clzll(number)) / 4 : 1);
+}
+
+/**
+ * Resolves every lookup address against a built index and prints one line per
+ * address: the address followed by symbol+0xoffset, or ?? when no symbol contains it.
+ *
+ * @param file The file whose SymbolTable holds the defined symbols and their sizes.
+ * @param index The lookup index of the file.
+ * @param options The options holding the addresses.
+ * @return 1 if the addresses were resolved, 0 otherwise.
+ */
+int resolve_lookups(File *file, LookupIndex *index, Options options)
+{
+    size_t *results;
+    uint32_t symbol;
+    char *name;
+    char *demangled;
+    int width = 8 + (!file->file_type) * 8;
+
+    if (!(results = malloc(sizeof(size_t) * (options.lookup_count + 1))))
+        return 0;
+    search_lookup_index(index, options.lookup_addresses, options.lookup_count, results);
+    for (size_t n = 0; n < options.lookup_count; n++)
+    {
+        output_hex(file->output, options.lookup_addresses[n], width);
+        output_char(file->output, ' ');
+        symbol = results[n] < index->count ? index->sorted[results[n]] : 0;
+        if (results[n] < index->count &&
+            (!index->extents[results[n]] ||
+             options.lookup_addresses[n] - file->symbols.values[symbol] < index->extents[results[n]]))
+        {
+            name = get_symbol_name(file, symbol);
+            if (options.demangle && (demangled = demangle_name(options.demangle, name)))
+                name = demangled;
+            output_string(file->output, name);
+            output_string(file->output, "+0x");
+            output_hex_minimal(file->output, options.lookup_addresses[n] - file->symbols.values[symbol]);
+        }
+        else
+            output_string(file->output, "??");
+        output_char(file->output, '\n');
+    }
+    free(results);
+    return 1;
+}
+
+/**
+ * Builds the lookup index of a file's symbols, then resolves every lookup address against it.
+ *
+ * @param file The file whose SymbolTable holds the defined symbols and their sizes.
+ * @param options The options holding the addresses.
+ * @return 1 if the addresses were resolved, 0 otherwise.
+ */
+int print_lookups(File *file, Options options)
+{
+    LookupIndex index;
+    uint64_t start;
+    int result;
+
+    start = stats_start(file->stats);
+    if (!build_lookup_index(&index, file))
+    {
+        free_lookup_index(&index);
+        return 0;
+    }
+    stats_stop(file->stats, PHASE_SORT, start);
+
+    start = stats_start(file->stats);
+    result = resolve_lookups(file, &index, options);
+    stats_stop(file->stats, PHASE_PRINT, start);
+
+    free_lookup_index(&index);
+    return result;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "nm.h"
+
+#define SPARSE_MAP_MIN (1 << 22) // Smaller files are mapped whole, a few extra pages cost less than extra mappings
+
+// A byte range of a file to map, rounded to pages when it is mapped
+struct MapRange
+{
+    uint64_t start;
+    uint64_t end;
+    bool sequential; // Read front to back, the kernel may read ahead aggressively and drop behind
+};
+
+/**
+ * Returns the number of pages covering a number of bytes.
+ *
+ * @param size The number of bytes.
+ * @return The number of pages.
+ */
+uint64_t page_count(uint64_t size)
+{
+    uint64_t page = sysconf(_SC_PAGESIZE);
+
+    return (size + page - 1) / page;
+}
+
+/**
+ * Orders map ranges by start offset.
+ *
+ * @param a The first MapRange.
+ * @param b The second MapRange.
+ * @return A negative value if a starts first, a positive value if b does, 0 otherwise.
+ */
+int compare_map_ranges(const void *a, const void *b)
+{
+    uint64_t first = ((const MapRange *)a)->start;
+    uint64_t second = ((const MapRange *)b)->start;
+
+    return (first > second) - (first < second);
+}
+
+/**
+ * Reserves the address range of a whole file without access, and maps its
+ * first page, holding the ELF header, at the start of the reservation.
+ *
+ * @param file The file, its size already set.
+ * @param fd The open descriptor of the file.
+ * @return The reservation, or NULL if it could not be made.
+ */
+void *map_reserve(File *file, int fd)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    char *base;
+
+    base = mmap(NULL, file->file_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (mmap(base, page, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(base, file->file_size);
+        return NULL;
+    }
+    return base;
+}
+
+/**
+ * Rounds ranges to whole pages, sorts them and merges the ones that overlap or touch.
+ *
+ * @param ranges The ranges, rewritten in place.
+ * @param count The number of ranges.
+ * @param limit The end of the file, no range is extended past its last page.
+ * @return The number of merged ranges, at the start of the array.
+ */
+size_t merge_map_ranges(MapRange *ranges, size_t count, uint64_t limit)
+{
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    size_t merged = 0;
+
+    limit = (limit + page - 1) & ~(page - 1);
+    for (size_t n = 0; n < count; n++)
+    {
+        ranges[n].start &= ~(page - 1);
+        ranges[n].end = (ranges[n].end + page - 1) & ~(page - 1);
+        if (ranges[n].end > limit)
+            ranges[n].end = limit;
+    }
+    qsort(ranges, count, sizeof(MapRange), compare_map_ranges);
+    for (size_t n = 0; n < count; n++)
+    {
+        if (merged && ranges[n].start <= ranges[merged - 1].end)
+        {
+            if (ranges[n].end > ranges[merged - 1].end)
+                ranges[merged - 1].end = ranges[n].end;
+            ranges[merged - 1].sequential |= ranges[n].sequential;
+        }
+        else if (ranges[n].start < ranges[n].end)
+            ranges[merged++] = ranges[n];
+    }
+    return merged;
+}
+
+/**
+ * Maps ranges of a file into its reservation, each at its own offset so that
+ * pointers computed from the start of the file stay valid. Ranges are merged
+ * before mapping, then the kernel is asked to read them in at once instead of
+ * one fault at a time.
+ *
+ * @param file The file, elf_header pointing at its reservation.
+ * @param fd The open descriptor of the file.
+ * @param ranges The ranges to map, sorted and merged in place.
+ * @param count The number of ranges.
+ * @param mapped Incremented by the number of bytes mapped.
+ * @return 1 if every range is mapped, 0 otherwise.
+ */
+int map_ranges(File *file, int fd, MapRange *ranges, size_t count, size_t *mapped)
+{
+    size_t merged = merge_map_ranges(ranges, count, file->file_size);
+    char *start;
+    size_t length;
+
+    for (size_t n = 0; n < merged; n++)
+    {
+        start = (char *)file->elf_header + ranges[n].start;
+        length = ranges[n].end - ranges[n].start;
+        if (mmap(start, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, ranges[n].start) == MAP_FAILED)
+            return 0;
+        if (ranges[n].sequential)
+            madvise(start, length, MADV_SEQUENTIAL);
+        madvise(start, length, MADV_WILLNEED);
+        *mapped += length;
+    }
+    return 1;
+}
+
+/**
+ * Maps the parts of a large ELF file its reader uses into its reservation:
+ * the section header table first, then the tables it lists. Code, data,
+ * relocation and debug sections are never mapped nor read.
+ *
+ * @param file The file, elf_header pointing at its reservation with the header page mapped.
+ * @param fd The open descriptor of the file.
+ * @param reader The reader of the file's class and byte order.
+ * @param mapped Incremented by the number of bytes mapped.
+ * @return 1 if the tables are mapped, 0 if the file has to be mapped whole.
+ */
+int map_tables(File *file, int fd, const ElfReader *reader, size_t *mapped)
+{
+    MapRange table;
+    MapRange *ranges;
+    size_t sections;
+    size_t count;
+    int result;
+
+    // Room for two ranges per section, counted with the smallest section header
+    if (!reader->section_table(file, &table))
+        return 0;
+    sections = (table.end - table.start) / sizeof(Elf32_Shdr);
+    if (!map_ranges(file, fd, &table, 1, mapped) || !(ranges = memory_allocate(file->allocator, sizeof(MapRange) * sections * 2)))
+        return 0;
+    count = reader->table_ranges(file, ranges);
+    result = map_ranges(file, fd, ranges, count, mapped);
+    memory_release(file->allocator, ranges);
+    return result;
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <unistd.h>
 #include <stdarg.h>
 #include <fcntl.h>
@@ -14,31 +18,74 @@
 #include <stdbool.h>
 
 #include "libft.h"
+#include "output.h"
+#include "pool.h"
+#include "stats.h"
 
-#define MAGIC_NUMBER 0x464C457F
-
-typedef struct MagicNumber
-{
-    uint32_t magic_number;
-    uint8_t support;
-    uint8_t endian;
-    uint8_t version;
-    uint8_t abi;
-} MagicNumber;
+// Archive members only start on 2-byte boundaries and are read in place, so the
+// tables of an image are read through types that require no alignment
+typedef uint16_t UnalignedUint16 __attribute__((aligned(1)));
+typedef uint32_t UnalignedUint32 __attribute__((aligned(1)));
+typedef uint64_t UnalignedUint64 __attribute__((aligned(1)));
 
+// Decoded view of one symbol, built on demand from the SymbolTable
 typedef struct Symbol
 {
     char *name;
-    char *original_name;
-    char *section;
-    int section_type;
-    int section_flags;
+    size_t value;
     int shndx;
-    char bind;
     char type;
-    size_t value;
+    char letter;
+    uint16_t version; // .gnu.version entry, 0 when the symbol has none
 } Symbol;
 
+// Compact structure-of-arrays symbol table, 19 bytes per symbol (27 with sizes, 2 more with versions)
+typedef struct SymbolTable
+{
+    size_t count;
+    uint64_t *values;
+    uint64_t *sizes;    // st_size of each symbol, only kept for address lookups and --diff-values
+    uint32_t *names;    // Offsets into the string table
+    uint32_t *order;    // Permutation of the symbol indexes in print order
+    uint16_t *sections; // Section header indexes
+    uint16_t *versions; // .gnu.version entries, only kept for dynamic symbols
+    uint8_t *infos;     // Packed bind and type, as in st_info
+    char **demangled;   // Demangled name of each symbol with -C, NULL entries print as is
+    const Allocator *allocator; // Allocator of the arrays, NULL for the C library's
+} SymbolTable;
+
+// Symbol version named by a .gnu.version entry
+typedef struct Version
+{
+    char *name;     // NULL for indexes neither defined nor needed
+    bool reference; // Needed from another object, listed in .gnu.version_r
+    bool base;      // The VER_FLG_BASE definition, naming the object itself
+} Version;
+
+typedef struct Section
+{
+    char *name;
+    uint32_t type;
+    uint64_t flags;
+    char letter; // Lowercase type letter of the symbols defined in the section, 0 if none applies
+} Section;
+
+#define FIND_LITERAL 1
+#define FIND_PREFIX 2
+#define FIND_GLOB 3
+
+typedef struct FindPattern
+{
+    char *pattern; // NULL unless --find is given
+    char form;     // FIND_LITERAL, FIND_PREFIX or FIND_GLOB
+    char *needle;  // Literal text every matching name contains
+    size_t needle_length;
+} FindPattern;
+
+typedef struct DemangleCache DemangleCache;
+typedef struct Prefetch Prefetch;
+typedef struct MapRange MapRange;
+
 typedef struct Options
 {
     char all;
@@ -46,264 +93,457 @@ typedef struct Options
     char undefined;
     char reverse;
     char not_sorted;
+    char archive_index;
+    char stats; // 0, STATS_TEXT or STATS_JSON
+    char dynamic; // Read .dynsym instead of .symtab
+    int jobs;
+    char *cache_directory; // NULL unless --cache is given
+    uint64_t cache_limit;  // Size cap of the cache directory, in bytes
+    char lookup;           // Resolve addresses instead of listing symbols
+    uint64_t *lookup_addresses;
+    size_t lookup_count;
+    FindPattern find;
+    char link_check; // Report unresolved and duplicate symbols across the files instead
+    char diff;        // Compare the symbols of two files instead of listing them
+    char diff_values; // Also report value and size changes
+    DemangleCache *demangle; // Demangled names shared by every file, NULL unless -C is given
+    char collate;            // Sort names in the LC_COLLATE order instead of byte order
+    char **directories;      // Trees walked with -R
+    int directory_count;
+    char summary;      // Print one inventory line per file instead of its symbols
+    char **file_lists; // Files naming one file per line, given as @file or --files-from
+    int file_list_count;
+    char *serve_socket;    // NULL unless --serve is given
+    uint64_t serve_budget; // Bytes of mapped files and symbol tables the server keeps resident
 } Options;
 
-typedef struct File
+typedef struct File File;
+
+// Class and byte order specific entry points, instantiated by elf_readers.h
+typedef struct ElfReader
+{
+    int (*check_file_data)(File *file, char *name, Options option);
+    int (*get_symbols)(File *file, Options option);
+    void (*stream_symbols)(File *file, Options option);
+    int (*find_symbols)(File *file, Options option);
+    int (*section_table)(File *file, MapRange *range);
+    size_t (*table_ranges)(File *file, MapRange *ranges);
+} ElfReader;
+
+struct File
 {
     int file_descriptor;
     size_t file_size;
-    Elf64_Ehdr *elf_header;
-    Elf64_Shdr *section_header;
-    Elf64_Sym *symbol_table;
-    Symbol *symbols;
-    int symbol_count;
+    void *elf_header;
+    void *section_header;
+    void *symbol_table;
+    SymbolTable symbols;
+    size_t symbol_count;
+    Section *sections;
+    size_t section_count;
     char *section_string_table;
+    size_t section_string_size;
     char *string_table;
+    size_t string_table_size;
+    UnalignedUint16 *version_table; // .gnu.version of the dynamic symbols, or NULL
+    Version *versions;              // Indexed by version, NULL without version sections
+    size_t version_count;
+    UnalignedUint32 *gnu_hash;      // .gnu.hash of the dynamic symbols, or NULL
+    size_t gnu_hash_size;
+    UnalignedUint32 *sysv_hash;     // .hash of the dynamic symbols, or NULL
+    size_t sysv_hash_size;
     char file_type;
-} File;
+    const ElfReader *reader;
+    Output *output;
+    Stats *stats; // NULL unless --stats is given
+    const Allocator *allocator; // Allocator of the tables decoded from the file, NULL for the C library's
+};
+
+typedef struct FileJobs
+{
+    char **files;
+    Options options;
+    bool multiple_programs;
+    Stats *stats;
+    int *errors; // errno of the walked directories that could not be read, NULL without -R
+    Prefetch *prefetch; // Batched opens and stats of the files, NULL when the jobs open them
+} FileJobs;
+
+#define EXTRACT_MIN_RUN (1 << 16) // Fewest symbols decoded by one thread of a parallel extraction
+#define PRINT_CHUNK (1 << 14)     // Symbols formatted by one job of a parallel print
+
+// A range of the symbol table decoded by one thread of a parallel extraction
+typedef struct ExtractRun
+{
+    File *file;
+    Options *option;
+    size_t start;
+    size_t end;
+    size_t count;  // Symbols of the range passing the filters
+    size_t offset; // Index of the first of them in the SymbolTable
+} ExtractRun;
 
 /**
- * Sorts an array of symbols using the quicksort algorithm.
+ * Allocates the arrays of a symbol table in a single block.
  *
- * @param symbols The array of symbols to be sorted.
- * @param len The number of symbols in the array.
+ * @param table The symbol table to allocate.
+ * @param count The number of symbols.
+ * @param sizes Whether the symbol sizes are kept.
+ * @param versions Whether the symbol versions are kept.
+ * @param allocator The allocator of the arrays, or NULL for the C library's.
+ * @return 1 if the allocation succeeded, 0 otherwise.
  */
-void quicksort_symbols(Symbol *symbols, int len)
+int alloc_symbol_table(SymbolTable *table, size_t count, bool sizes, bool versions, const Allocator *allocator)
 {
-    char *pivot;
-    Symbol tempSymbol;
-    int currentIndex;
-    int pivotIndex;
+    char *block;
 
-    if (len < 2)
-        return;
+    // Arrays are laid out by decreasing alignment so none needs padding, order holds 32-bit indexes
+    if (count > UINT32_MAX ||
+        !(block = memory_allocate(allocator, count * ((1 + sizes) * sizeof(uint64_t) + 2 * sizeof(uint32_t) +
+                                                      (1 + versions) * sizeof(uint16_t) + sizeof(uint8_t)))))
+        return 0;
+    table->values = (uint64_t *)block;
+    table->sizes = sizes ? table->values + count : NULL;
+    table->names = (uint32_t *)(table->values + count * (1 + sizes));
+    table->order = table->names + count;
+    table->sections = (uint16_t *)(table->order + count);
+    table->versions = versions ? table->sections + count : NULL;
+    table->infos = (uint8_t *)(table->sections + count * (1 + versions));
+    table->demangled = NULL;
+    table->allocator = allocator;
+    table->count = count;
+    return 1;
+}
 
-    // Select the last symbol as the pivot
-    pivot = symbols[len - 1].name;
-    currentIndex = 0;
-    pivotIndex = -1;
+/**
+ * Returns the object type of a mapped ELF image, its e_type, which sits at
+ * the same offset in both classes.
+ *
+ * @param file The mapped image.
+ * @return The object type.
+ */
+uint16_t elf_object_type(File *file)
+{
+    unsigned char *header = file->elf_header;
 
-    // Partition the array based on the pivot
-    while (++pivotIndex < len)
-    {
-        if (string_compare(symbols[pivotIndex].name, pivot) <= 0)
-        {
-            if (currentIndex != pivotIndex)
-            {
-                // Swap symbols
-                tempSymbol = symbols[currentIndex];
-                symbols[currentIndex] = symbols[pivotIndex];
-                symbols[pivotIndex] = tempSymbol;
-            }
-            currentIndex++;
-        }
-    }
+    return header[EI_DATA] == ELFDATA2MSB ? header[16] << 8 | header[17] : header[17] << 8 | header[16];
+}
+
+/**
+ * Hashes a symbol name with 64-bit FNV-1a.
+ *
+ * @param name The name to hash.
+ * @return The hash of the name.
+ */
+uint64_t name_hash(const char *name)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
 
-    // Recursively sort the subarrays
-    quicksort_symbols(symbols, --currentIndex);
-    quicksort_symbols(&symbols[currentIndex], len - currentIndex);
+    while (*name)
+        hash = (hash ^ (unsigned char)*name++) * 0x100000001b3ULL;
+    return hash;
 }
 
 /**
- * Sorts an array of symbols in reverse order using the quicksort algorithm.
+ * Releases the arrays of a symbol table.
  *
- * @param symbols The array of symbols to be sorted.
- * @param len The number of symbols in the array.
+ * @param table The symbol table to release.
  */
-void reverse_quicksort_symbols(Symbol *symbols, int len)
+void free_symbol_table(SymbolTable *table)
 {
-    char *pivot;
-    Symbol tempSymbol;
-    int currentIndex;
-    int pivotIndex;
+    memory_release(table->allocator, table->values);
+    memory_release(table->allocator, table->demangled);
+    be_zero(table, sizeof(SymbolTable));
+}
 
-    if (len < 2)
-        return;
+/**
+ * Releases the section and version tables decoded by check_file_data.
+ *
+ * @param file The file whose tables are released.
+ */
+void free_file_tables(File *file)
+{
+    memory_release(file->allocator, file->sections);
+    memory_release(file->allocator, file->versions);
+    file->sections = NULL;
+    file->versions = NULL;
+}
 
-    // Select the last symbol as the pivot
-    pivot = symbols[len - 1].name;
-    currentIndex = 0;
-    pivotIndex = -1;
+/**
+ * Returns the section a symbol belongs to, or the first section for
+ * reserved and out of range section indexes.
+ *
+ * @param file The file containing the symbol.
+ * @param index The index of the symbol.
+ * @return The section of the symbol.
+ */
+Section *get_symbol_section(File *file, uint32_t index)
+{
+    uint16_t shndx = file->symbols.sections[index];
 
-    // Partition the array based on the pivot
-    while (++pivotIndex < len)
-    {
-        if (string_compare(symbols[pivotIndex].name, pivot) >= 0)
-        {
-            if (currentIndex != pivotIndex)
-            {
-                // Swap symbols
-                tempSymbol = symbols[currentIndex];
-                symbols[currentIndex] = symbols[pivotIndex];
-                symbols[pivotIndex] = tempSymbol;
-            }
-            currentIndex++;
-        }
-    }
+    return &file->sections[shndx < file->section_count ? shndx : 0];
+}
+
+/**
+ * Returns the name a symbol is printed and sorted with: its own name, or the
+ * name of its section when it has none.
+ *
+ * @param file The file containing the symbol.
+ * @param index The index of the symbol.
+ * @return The name of the symbol.
+ */
+char *get_symbol_name(File *file, uint32_t index)
+{
+    uint32_t offset = file->symbols.names[index];
 
-    // Recursively sort the subarrays
-    reverse_quicksort_symbols(symbols, --currentIndex);
-    reverse_quicksort_symbols(&symbols[currentIndex], len - currentIndex);
+    if (offset < file->string_table_size && file->string_table[offset])
+        return &file->string_table[offset];
+    return get_symbol_section(file, index)->name;
 }
 
 /**
- * Prints errors related to the file.
- * 
- * @param preMessage The message to be printed before the file name.
- * @param name The name of the file.
- * @param afterMessage The message to be printed after the file name.
+ * Computes the lowercase type letter of the symbols defined in a section,
+ * once per section header.
+ *
+ * @param section The section to classify.
+ * @return The type letter, or 0 if the symbol type decides between 'C' and '?'.
  */
-int print_file_errors(char *preMessage, char *name, char *afterMessage)
+char classify_section(Section *section)
 {
-    write(1, TOOL_NAME, sizeof(TOOL_NAME));
-    write(1, preMessage, string_length(preMessage));
-    write(1, name, string_length(name));
-    write(1, afterMessage, string_length(afterMessage));
+    // Check if the section has no name
+    if (!section->name[0])
+        return 'a';
+    // Check if the section type is SHT_NOBITS
+    if (section->type == SHT_NOBITS)
+        return 'b';
+    // Check if the section flags indicate merge and strings, or if there are no flags
+    if (section->flags == (SHF_MERGE | SHF_STRINGS) || !section->flags)
+        return 'n';
+    // Check if the section flags contain executable instructions
+    if (section->flags & SHF_EXECINSTR)
+        return 't';
+    // Check if the section flags indicate write and allocate, TLS and group flags aside
+    if ((section->flags & ~(uint64_t)(SHF_TLS | SHF_GROUP)) == (SHF_WRITE | SHF_ALLOC))
+        return 'd';
+    // Check if the section flags contain allocate
+    if (section->flags & SHF_ALLOC)
+        return 'r';
     return 0;
 }
 
+// Type letters decided by bind and type alone, indexed by [bind][type]; 0 defers to the section
+#define SYMBOL_CLASS_DEFAULT {[STT_FILE] = 'a', [STT_GNU_IFUNC] = 'i'}
+static const char symbol_classes[16][16] = {
+    SYMBOL_CLASS_DEFAULT,
+    {[STT_FILE] = 'A', [STT_GNU_IFUNC] = 'i'},
+    {'W', 'V', 'W', 'W', 'W', 'W', 'W', 'W', 'W', 'W', 'i', 'W', 'W', 'W', 'W', 'W'},
+    SYMBOL_CLASS_DEFAULT, SYMBOL_CLASS_DEFAULT, SYMBOL_CLASS_DEFAULT, SYMBOL_CLASS_DEFAULT,
+    SYMBOL_CLASS_DEFAULT, SYMBOL_CLASS_DEFAULT, SYMBOL_CLASS_DEFAULT,
+    {'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u'}, // STB_GNU_UNIQUE
+    SYMBOL_CLASS_DEFAULT, SYMBOL_CLASS_DEFAULT, SYMBOL_CLASS_DEFAULT, SYMBOL_CLASS_DEFAULT,
+    SYMBOL_CLASS_DEFAULT,
+};
+
 /**
- * Returns the length of a number represented in hexadecimal format.
+ * Retrieves the symbol character from the (bind, type) table and the
+ * precomputed classification of the symbol's section.
  *
- * @param number The number to calculate the length of.
- * @return The length of the hexadecimal number.
+ * @param file The file containing the symbol.
+ * @param shndx The section header index of the symbol.
+ * @param info The packed bind and type of the symbol.
+ * @return The symbol character.
  */
-int hex_number_len(size_t number)
+char get_symbol_char(File *file, uint16_t shndx, uint8_t info)
 {
-    int length = 0;
-    while (number)
-    {
-        number /= 16;
-        length++;
-    }
-    return length;
+    char letter = symbol_classes[info >> 4][info & 0xf];
+
+    // Weak symbols are lowercase when undefined
+    if (letter)
+        return (letter == 'W' || letter == 'V') && !shndx ? (char)(letter + ('a' - 'A')) : letter;
+
+    // Defined symbols take the letter of their section, undefined ones are 'u'
+    if (shndx)
+        letter = file->sections[shndx < file->section_count ? shndx : 0].letter;
+    else if ((info & 0xf) != STT_COMMON)
+        letter = 'u';
+    if (!letter)
+        return (info & 0xf) == STT_COMMON ? 'C' : '?';
+    return (info >> 4) == STB_GLOBAL ? (char)(letter - ('a' - 'A')) : letter;
 }
 
 /**
- * Prints a number in hexadecimal format.
+ * Checks whether a symbol passes the filters of the provided options.
+ * Filters run on the raw fields, before anything is stored or sorted.
  *
- * @param number The number to be printed.
+ * @param file The file containing the symbol.
+ * @param name The offset of the symbol name in the string table.
+ * @param shndx The section header index of the symbol.
+ * @param info The packed bind and type of the symbol.
+ * @param option The options specifying which symbols to keep.
+ * @return true if the symbol is kept, false otherwise.
  */
-void print_hex_number(size_t number)
+bool select_symbol(File *file, uint32_t name, uint16_t shndx, uint8_t info, Options option)
 {
-    static char hex[] = "0123456789abcdef";
+    uint8_t bind = info >> 4;
+    uint8_t type = info & 0xf;
 
-    if (number >= 16)
-    {
-        print_hex_number(number / 16);
-        print_hex_number(number % 16);
-    }
-    else
-    {
-        write(1, hex + number, 1);
-    }
+    if (option.lookup)
+        return shndx && shndx < SHN_LORESERVE && type != STT_FILE && type != STT_SECTION &&
+               name < file->string_table_size && file->string_table[name] &&
+               (!option.globals || bind == STB_GLOBAL || bind == STB_WEAK || bind == STB_GNU_UNIQUE);
+    if (option.undefined)
+        return !shndx && type != STT_FILE && !(type == STT_NOTYPE && bind < STB_WEAK) &&
+               (!option.globals || bind == STB_GLOBAL || bind == STB_WEAK || bind == STB_GNU_UNIQUE);
+    if (!option.all && (name >= file->string_table_size || !file->string_table[name] || type == STT_FILE))
+        return false;
+    return !option.globals || bind == STB_GLOBAL || bind == STB_WEAK || bind == STB_GNU_UNIQUE;
 }
 
 /**
- * Retrieves the global symbol if the given symbol is of global bind.
+ * Builds the decoded view of a symbol from its raw fields.
  *
- * @param symbol The symbol to check.
- * @param c The character to modify.
- * @return The modified character based on the symbol bind.
+ * @param file The file containing the symbol.
+ * @param name The offset of the symbol name in the string table.
+ * @param value The value of the symbol.
+ * @param shndx The section header index of the symbol.
+ * @param info The packed bind and type of the symbol.
+ * @return The decoded symbol.
  */
-char get_global_symbol(Symbol symbol, char c)
+Symbol make_symbol(File *file, uint32_t name, uint64_t value, uint16_t shndx, uint8_t info)
 {
-    return symbol.bind == STB_GLOBAL ? (char)(c - ('a' - 'A')) : c;
+    Symbol symbol;
+
+    symbol.name = name < file->string_table_size ? &file->string_table[name] : "";
+    if (!symbol.name[0])
+        symbol.name = file->sections[shndx < file->section_count ? shndx : 0].name;
+    symbol.shndx = shndx;
+    symbol.type = info & 0xf;
+    symbol.value = value;
+    symbol.letter = get_symbol_char(file, shndx, info);
+    symbol.version = 0;
+    return symbol;
 }
+
 /**
- * Retrieves the symbol character based on the symbol's bind, type, and other conditions.
+ * Decodes one entry of the symbol table.
  *
- * @param symbol The symbol to retrieve the character for.
- * @return The symbol character.
+ * @param file The file containing the symbol.
+ * @param index The index of the symbol.
+ * @return The decoded symbol.
+ */
+Symbol get_symbol(File *file, uint32_t index)
+{
+    Symbol symbol;
+
+    symbol = make_symbol(file, file->symbols.names[index], file->symbols.values[index],
+                         file->symbols.sections[index], file->symbols.infos[index]);
+    if (file->symbols.versions)
+        symbol.version = file->symbols.versions[index];
+    if (file->symbols.demangled && file->symbols.demangled[index])
+        symbol.name = file->symbols.demangled[index];
+    return symbol;
+}
+
+/**
+ * Appends the version of a dynamic symbol to its name, the way GNU nm does:
+ * "@@" for the default version of a defined symbol, "@" for hidden versions
+ * and undefined symbols. The local and base versions, and version definition
+ * symbols named after their version, print nothing.
+ *
+ * @param file The file containing the symbol.
+ * @param symbol The symbol being printed.
  */
-char get_symbol_char(Symbol symbol)
+void print_symbol_version(File *file, Symbol symbol)
 {
-    // Check if the symbol is weak and of type object
-    if (symbol.bind == STB_WEAK && symbol.type == STT_OBJECT)
+    uint16_t index = symbol.version & 0x7fff;
+    Version *version;
+
+    if (!file->versions || index < 1 || index >= file->version_count || !file->versions[index].name)
+        return;
+    version = &file->versions[index];
+    if ((index == 1 && version->base) || (!version->reference && !string_compare(version->name, symbol.name)))
+        return;
+    if (symbol.version & 0x8000 || version->reference || !symbol.shndx)
+        output_char(file->output, '@');
+    else
+        output_write(file->output, "@@", 2);
+    output_string(file->output, version->name);
+}
+
+/**
+ * Prints one symbol.
+ *
+ * @param file The file containing the symbol.
+ * @param symbol The symbol to print.
+ */
+void print_symbol(File *file, Symbol symbol)
+{
+    int width;
+    char type[] = "   ";
+
+    width = 8 + (!file->file_type) * 8;
+    if (symbol.shndx || symbol.type == STT_FILE)
     {
-        if (symbol.shndx)
-            return 'V'; // Weak object symbol with defined section
-        return 'v'; // Weak object symbol without defined section
+        // Print the symbol value in fixed-width hexadecimal format
+        output_hex(file->output, symbol.value, width);
     }
-    // Check if the symbol is weak
-    if (symbol.bind == STB_WEAK)
+    else
     {
-        if (symbol.shndx)
-            return 'W'; // Weak symbol with defined section
-        return 'w'; // Weak symbol without defined section
+        // Print spaces if the symbol does not have a value
+        output_fill(file->output, ' ', width);
     }
-    // Check if the symbol is of type GNU indirect function
-    if (symbol.type == STT_GNU_IFUNC)
-        return 'i';
-    // Check if the symbol is of type file or if it has no section and defined index
-    if (symbol.type == STT_FILE || (!symbol.section[0] && symbol.shndx))
-        return get_global_symbol(symbol, 'a'); // Get the global symbol character
-    // Check if the symbol's section type is SHT_NOBITS
-    if (symbol.section_type == SHT_NOBITS)
-        return get_global_symbol(symbol, 'b'); // Get the global symbol character
-    // Check if the symbol's section flags indicate merge and strings, or if it has no section flags and defined index
-    if (symbol.section_flags == (SHF_MERGE | SHF_STRINGS) || (!symbol.section_flags && symbol.shndx))
-        return get_global_symbol(symbol, 'n'); // Get the global symbol character
-    // Check if the symbol's section flags contain executable instructions
-    if ((symbol.section_flags & SHF_EXECINSTR))
-        return get_global_symbol(symbol, 't'); // Get the global symbol character
-    // Check if the symbol's section flags indicate write and allocate
-    if (symbol.section_flags == (SHF_WRITE | SHF_ALLOC))
-        return get_global_symbol(symbol, 'd'); // Get the global symbol character
-    // Check if the symbol's section flags contain allocate
-    if ((symbol.section_flags & SHF_ALLOC))
-        return get_global_symbol(symbol, 'r'); // Get the global symbol character
-    // Check if the symbol is of type common
-    if (symbol.type == STT_COMMON)
-        return 'C';
-    // Check if the symbol has no defined index
-    if (!symbol.shndx)
-        return get_global_symbol(symbol, 'u'); // Get the global symbol character
-    // Return '?' for unknown cases
-    return '?';
+
+    // Append the symbol type and name to the output buffer
+    type[1] = symbol.letter;
+    output_write(file->output, type, 3);
+    output_string(file->output, symbol.name);
+    if (symbol.version)
+        print_symbol_version(file, symbol);
+    output_char(file->output, '\n');
+    if (file->stats)
+        file->stats->symbols_printed++;
+}
+
+/**
+ * Job routine formatting one chunk of a file's symbols, in sorted order.
+ *
+ * @param context The File whose symbols are printed.
+ * @param index The index of the chunk, PRINT_CHUNK symbols each.
+ * @param output The output the chunk is formatted into.
+ * @return 1.
+ */
+int print_chunk_job(void *context, size_t index, Output *output)
+{
+    File chunk = *(File *)context;
+    size_t end = (index + 1) * PRINT_CHUNK < chunk.symbols.count ? (index + 1) * PRINT_CHUNK : chunk.symbols.count;
+
+    // The symbols are counted once every chunk is printed
+    chunk.output = output;
+    chunk.stats = NULL;
+    for (size_t n = index * PRINT_CHUNK; n < end; n++)
+        print_symbol(&chunk, get_symbol(&chunk, chunk.symbols.order[n]));
+    return 1;
 }
 
 /**
- * Prints symbols based on the provided file and options.
+ * Prints the symbols of the file's SymbolTable in their sorted order.
+ * The table only holds symbols that passed the filters during extraction.
+ * Large tables are formatted in chunks on up to `jobs` threads, written in order.
  *
  * @param file The file containing the symbols.
- * @param option The options specifying which symbols to print.
+ * @param jobs The threads the print may use, 1 to print on the calling thread only.
  */
-void print_symbols(File *file, Options option)
+void print_symbols(File *file, int jobs)
 {
-    int n;
-    static char type[] = "   ";
-    static char zeros[] = "0000000000000000";
+    size_t chunks = (file->symbols.count + PRINT_CHUNK - 1) / PRINT_CHUNK;
 
-    n = 0;
-    while (++n < file->symbol_count)
+    if (chunks > 1 && jobs > 1)
     {
-        // Check if the symbol should be printed based on the specified options
-        if ((option.undefined && (file->symbols[n].shndx || file->symbols[n].type == STT_FILE || (file->symbols[n].type == STT_NOTYPE && file->symbols[n].bind < STB_WEAK))) ||
-            (!option.all && !option.undefined && (!file->symbols[n].original_name[0] || file->symbols[n].type == STT_FILE)) ||
-            (option.globals && (file->symbols[n].bind != STB_GLOBAL && file->symbols[n].bind != STB_WEAK)))
-        {
-            continue; // Skip the symbol if it doesn't meet the printing criteria
-        }
-        
-        if (file->symbols[n].shndx || file->symbols[n].type == STT_FILE)
-        {
-            // Print the symbol value in hexadecimal format
-            write(1, zeros, 8 + (!file->file_type) * 8 - hex_number_len(file->symbols[n].value));
-            print_hex_number(file->symbols[n].value);
-        }
-        else
-        {
-            // Print spaces if the symbol does not have a value
-            write(1, "                ", 8 + (!file->file_type) * 8);
-        }
-
-        // Get the symbol character based on the symbol information
-        type[1] = get_symbol_char(file->symbols[n]);
-
-        // Write the symbol type and name to the standard output
-        write(1, type, 3);
-        write(1, file->symbols[n].name, string_length(file->symbols[n].name));
-        write(1, "\n", 1);
+        run_ordered_jobs(print_chunk_job, file, chunks, jobs, file->output);
+        if (file->stats)
+            file->stats->symbols_printed += file->symbols.count;
+        return;
     }
+    for (size_t n = 0; n < file->symbols.count; n++)
+        print_symbol(file, get_symbol(file, file->symbols.order[n]));
 }
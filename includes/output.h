@@ -0,0 +1,294 @@
+#pragma once
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "libft.h"
+#include "allocator.h"
+
+#define OUTPUT_BUFFER_SIZE (1 << 18)
+#define OUTPUT_MEMORY_SIZE 4096
+
+typedef struct Output
+{
+    int file_descriptor; // -1 for outputs that only grow in memory
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    uint64_t flushed;     // Bytes handed to write() so far
+    uint64_t write_calls; // Flushes that issued a write() call
+    const Allocator *allocator; // Allocator of the buffer, NULL for the C library's
+} Output;
+
+/**
+ * Initializes an output buffer allocated with the given allocator.
+ *
+ * @param output The output to initialize.
+ * @param file_descriptor The file descriptor the buffer is flushed to, -1 for an in-memory output.
+ * @param allocator The allocator of the buffer, or NULL for the C library's.
+ * @return 1 if the buffer was allocated, 0 otherwise.
+ */
+int output_init_allocator(Output *output, int file_descriptor, const Allocator *allocator)
+{
+    output->file_descriptor = file_descriptor;
+    output->length = 0;
+    output->flushed = 0;
+    output->write_calls = 0;
+    output->allocator = allocator;
+    output->capacity = file_descriptor < 0 ? OUTPUT_MEMORY_SIZE : OUTPUT_BUFFER_SIZE;
+    if (!(output->buffer = memory_allocate(allocator, output->capacity)))
+        return 0;
+    return 1;
+}
+
+/**
+ * Initializes an output buffer bound to a file descriptor.
+ *
+ * @param output The output to initialize.
+ * @param file_descriptor The file descriptor the buffer is flushed to.
+ * @return 1 if the buffer was allocated, 0 otherwise.
+ */
+int output_init(Output *output, int file_descriptor)
+{
+    return output_init_allocator(output, file_descriptor, NULL);
+}
+
+/**
+ * Initializes a growable in-memory output, never flushed to a file descriptor.
+ *
+ * @param output The output to initialize.
+ * @return 1 if the buffer was allocated, 0 otherwise.
+ */
+int output_init_memory(Output *output)
+{
+    return output_init(output, -1);
+}
+
+/**
+ * Writes a whole memory region to a file descriptor, retrying on partial writes.
+ *
+ * @param file_descriptor The file descriptor to write to.
+ * @param data The data to write.
+ * @param length The number of bytes to write.
+ * @return 1 if everything was written, 0 otherwise.
+ */
+int write_all(int file_descriptor, const char *data, size_t length)
+{
+    ssize_t written;
+
+    while (length)
+    {
+        written = write(file_descriptor, data, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return 0;
+        data += written;
+        length -= written;
+    }
+    return 1;
+}
+
+/**
+ * Flushes the buffered bytes to the output file descriptor.
+ *
+ * @param output The output to flush.
+ * @return 1 if the flush succeeded, 0 otherwise.
+ */
+int output_flush(Output *output)
+{
+    int result;
+
+    // In-memory outputs keep their content until it is released by the caller
+    if (output->file_descriptor < 0 || !output->length)
+        return 1;
+
+    result = write_all(output->file_descriptor, output->buffer, output->length);
+    output->flushed += output->length;
+    output->write_calls++;
+    output->length = 0;
+    return result;
+}
+
+/**
+ * Releases the output buffer after flushing what is left in it.
+ *
+ * @param output The output to release.
+ */
+void output_release(Output *output)
+{
+    output_flush(output);
+    memory_release(output->allocator, output->buffer);
+    output->buffer = NULL;
+    output->capacity = 0;
+}
+
+/**
+ * Makes sure the buffer has room for the given number of bytes, flushing it
+ * or, for in-memory outputs, growing it if needed.
+ *
+ * @param output The output to prepare.
+ * @param length The number of bytes about to be appended.
+ * @return 1 if the bytes fit in the buffer, 0 if they have to bypass it.
+ */
+int output_reserve(Output *output, size_t length)
+{
+    size_t capacity;
+    char *buffer;
+
+    if (output->length + length <= output->capacity)
+        return 1;
+    if (output->file_descriptor >= 0)
+    {
+        output_flush(output);
+        return length <= output->capacity;
+    }
+
+    // Grow in-memory outputs geometrically
+    capacity = output->capacity ? output->capacity : OUTPUT_MEMORY_SIZE;
+    while (capacity < output->length + length)
+        capacity *= 2;
+    if (!(buffer = memory_reallocate(output->allocator, output->buffer, capacity)))
+        return 0;
+    output->buffer = buffer;
+    output->capacity = capacity;
+    return 1;
+}
+
+/**
+ * Appends a memory region to the output buffer.
+ *
+ * @param output The output to append to.
+ * @param data The data to append.
+ * @param length The number of bytes to append.
+ */
+void output_write(Output *output, const char *data, size_t length)
+{
+    // Regions bigger than the whole buffer are written straight through
+    if (!output_reserve(output, length))
+    {
+        if (output->file_descriptor >= 0)
+        {
+            write_all(output->file_descriptor, data, length);
+            output->flushed += length;
+            output->write_calls++;
+        }
+        return;
+    }
+    memcpy(output->buffer + output->length, data, length);
+    output->length += length;
+}
+
+/**
+ * Appends a null-terminated string to the output buffer.
+ *
+ * @param output The output to append to.
+ * @param string The string to append.
+ */
+void output_string(Output *output, const char *string)
+{
+    output_write(output, string, string_length((char *)string));
+}
+
+/**
+ * Appends a single character to the output buffer.
+ *
+ * @param output The output to append to.
+ * @param c The character to append.
+ */
+void output_char(Output *output, char c)
+{
+    if (output->length == output->capacity && !output_reserve(output, 1))
+        return;
+    output->buffer[output->length++] = c;
+}
+
+/**
+ * Appends the same character several times to the output buffer.
+ *
+ * @param output The output to append to.
+ * @param c The character to repeat.
+ * @param count The number of repetitions.
+ */
+void output_fill(Output *output, char c, size_t count)
+{
+    output_reserve(output, count);
+    while (count--)
+        output_char(output, c);
+}
+
+/**
+ * Appends a number in zero-padded, fixed-width hexadecimal format.
+ *
+ * @param output The output to append to.
+ * @param number The number to format.
+ * @param width The number of digits to produce.
+ */
+void output_hex(Output *output, size_t number, int width)
+{
+    static const char hex[] = "0123456789abcdef";
+    char *digits;
+
+    if (!output_reserve(output, width))
+        return;
+    digits = output->buffer + output->length;
+    output->length += width;
+
+    // Fill the digits from the least significant nibble backwards
+    while (width--)
+    {
+        digits[width] = hex[number & 0xf];
+        number >>= 4;
+    }
+}
+
+/**
+ * Appends an unsigned number in decimal format.
+ *
+ * @param output The output to append to.
+ * @param number The number to format.
+ */
+void output_decimal(Output *output, uint64_t number)
+{
+    char digits[20];
+    int length = 0;
+
+    // Produce the digits from the least significant one backwards
+    do
+    {
+        digits[sizeof(digits) - ++length] = '0' + number % 10;
+        number /= 10;
+    } while (number);
+    output_write(output, digits + sizeof(digits) - length, length);
+}
+
+/**
+ * Returns the total number of bytes appended to an output so far.
+ *
+ * @param output The output to measure.
+ * @return The number of bytes flushed plus the number still buffered.
+ */
+uint64_t output_total(Output *output)
+{
+    return output->flushed + output->length;
+}
+
+/**
+ * Prints file errors with the provided pre-message, name, and after-message.
+ *
+ * @param output The output the error is appended to.
+ * @param pre_message The pre-message to be printed.
+ * @param name The name to be printed.
+ * @param after_message The after-message to be printed.
+ * @return 0 to indicate successful execution.
+ */
+int file_errors(Output *output, char *pre_message, char *name, char *after_message)
+{
+    output_write(output, TOOL_NAME, sizeof(TOOL_NAME) - 1);
+    output_string(output, pre_message);
+    output_string(output, name);
+    output_string(output, after_message);
+    return 0;
+}
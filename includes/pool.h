@@ -0,0 +1,248 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "output.h"
+
+#define POOL_WINDOW_PER_WORKER 4
+#define PARALLEL_MAX_THREADS 64
+
+typedef int (*JobRoutine)(void *context, size_t index, Output *output);
+
+typedef struct WorkPool
+{
+    JobRoutine routine;
+    void *context;
+    size_t count;
+    size_t next;
+    size_t released;
+    size_t window;
+    Output *outputs;
+    int *results;
+    bool *done;
+    pthread_mutex_t lock;
+    pthread_cond_t job_done;
+    pthread_cond_t job_released;
+} WorkPool;
+
+/**
+ * Returns the number of online processors, at least 1.
+ *
+ * @return The number of online processors.
+ */
+int get_core_count(void)
+{
+    long cores;
+
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+/**
+ * Returns the number of threads to split a number of items between, one per
+ * online processor as long as each thread gets at least a minimum of items.
+ *
+ * @param count The number of items.
+ * @param minimum The fewest items worth a thread.
+ * @return A number of threads between 1 and PARALLEL_MAX_THREADS.
+ */
+int split_thread_count(size_t count, size_t minimum)
+{
+    size_t threads = get_core_count();
+
+    if (threads > PARALLEL_MAX_THREADS)
+        threads = PARALLEL_MAX_THREADS;
+    if (threads > count / minimum)
+        threads = count / minimum;
+    return threads ? (int)threads : 1;
+}
+
+/**
+ * Splits a thread budget between the jobs of a pool: each of the workers
+ * running at once gets an equal share for the threads of its own job, so that
+ * a job parallel on its own never takes the run past the budget.
+ *
+ * @param jobs The threads of the budget, at least 1.
+ * @param count The number of jobs of the pool.
+ * @return The threads one job may use, at least 1.
+ */
+int share_job_budget(int jobs, size_t count)
+{
+    size_t workers = count < (size_t)jobs ? count : (size_t)jobs;
+
+    return workers > 1 ? jobs / (int)workers : jobs;
+}
+
+/**
+ * Runs a routine over several runs, each on its own thread, the first on the
+ * calling thread, and waits for all of them. Runs whose thread cannot be
+ * created are handled by the calling thread.
+ *
+ * @param routine The function to run.
+ * @param runs The runs to process, an array of elements of `size` bytes.
+ * @param size The size of one run.
+ * @param count The number of runs, at most PARALLEL_MAX_THREADS.
+ */
+void run_threads(void *(*routine)(void *), void *runs, size_t size, int count)
+{
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    bool started[PARALLEL_MAX_THREADS];
+
+    for (int n = 1; n < count; n++)
+        started[n] = !pthread_create(&threads[n], NULL, routine, (char *)runs + n * size);
+    if (count)
+        routine(runs);
+    for (int n = 1; n < count; n++)
+    {
+        if (started[n])
+            pthread_join(threads[n], NULL);
+        else
+            routine((char *)runs + n * size);
+    }
+}
+
+/**
+ * Worker loop: claims the next job, runs it into its own in-memory output and
+ * marks it as done. Workers never run more than `window` jobs ahead of the
+ * oldest unreleased one, which bounds the memory held by buffered outputs.
+ *
+ * @param argument The WorkPool the worker belongs to.
+ * @return NULL.
+ */
+void *pool_worker(void *argument)
+{
+    WorkPool *pool = argument;
+    size_t index;
+    int result;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->count)
+    {
+        if (pool->next >= pool->released + pool->window)
+        {
+            pthread_cond_wait(&pool->job_released, &pool->lock);
+            continue;
+        }
+        index = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        // Run the job outside of the lock
+        if (output_init_memory(&pool->outputs[index]))
+            result = pool->routine(pool->context, index, &pool->outputs[index]);
+        else
+            result = 0;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->results[index] = result;
+        pool->done[index] = true;
+        pthread_cond_broadcast(&pool->job_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * Runs `count` jobs serially, straight into the destination output.
+ *
+ * @param routine The function running one job.
+ * @param context The context passed to every job.
+ * @param count The number of jobs.
+ * @param destination The output every job writes to.
+ * @return The number of jobs that failed.
+ */
+size_t run_serial_jobs(JobRoutine routine, void *context, size_t count, Output *destination)
+{
+    size_t failures = 0;
+
+    for (size_t index = 0; index < count; index++)
+        failures += !routine(context, index, destination);
+    return failures;
+}
+
+/**
+ * Runs `count` jobs on a pool of worker threads. Each job writes to its own
+ * in-memory output, and the calling thread releases those outputs to the
+ * destination strictly in job order, so the result is byte-identical to a
+ * serial run. A failing job does not stop the others.
+ *
+ * @param routine The function running one job.
+ * @param context The context passed to every job.
+ * @param count The number of jobs.
+ * @param workers The number of worker threads.
+ * @param destination The output the job outputs are released to.
+ * @return The number of jobs that failed.
+ */
+size_t run_ordered_jobs(JobRoutine routine, void *context, size_t count, int workers, Output *destination)
+{
+    WorkPool pool = {0};
+    pthread_t *threads;
+    int started = 0;
+    size_t failures = 0;
+
+    if ((size_t)workers > count)
+        workers = (int)count;
+    if (workers <= 1)
+        return run_serial_jobs(routine, context, count, destination);
+
+    // Allocate the per-job bookkeeping
+    pool.routine = routine;
+    pool.context = context;
+    pool.count = count;
+    pool.window = (size_t)workers * POOL_WINDOW_PER_WORKER;
+    pool.outputs = malloc(sizeof(Output) * count);
+    pool.results = malloc(sizeof(int) * count);
+    pool.done = calloc(count, sizeof(bool));
+    threads = malloc(sizeof(pthread_t) * workers);
+    if (!pool.outputs || !pool.results || !pool.done || !threads)
+    {
+        free(pool.outputs);
+        free(pool.results);
+        free(pool.done);
+        free(threads);
+        return run_serial_jobs(routine, context, count, destination);
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.job_done, NULL);
+    pthread_cond_init(&pool.job_released, NULL);
+
+    // Start the workers, running every job on this thread if none could be created
+    while (started < workers && !pthread_create(&threads[started], NULL, pool_worker, &pool))
+        started++;
+    if (!started)
+    {
+        pool.window = count;
+        pool_worker(&pool);
+    }
+
+    // Release every job's output in order as soon as it is complete
+    pthread_mutex_lock(&pool.lock);
+    while (pool.released < count)
+    {
+        if (!pool.done[pool.released])
+        {
+            pthread_cond_wait(&pool.job_done, &pool.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool.lock);
+        output_write(destination, pool.outputs[pool.released].buffer, pool.outputs[pool.released].length);
+        output_flush(destination);
+        free(pool.outputs[pool.released].buffer);
+        failures += !pool.results[pool.released];
+        pthread_mutex_lock(&pool.lock);
+        pool.released++;
+        pthread_cond_broadcast(&pool.job_released);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    // Wait for the workers and free the bookkeeping
+    while (started--)
+        pthread_join(threads[started], NULL);
+    pthread_cond_destroy(&pool.job_released);
+    pthread_cond_destroy(&pool.job_done);
+    pthread_mutex_destroy(&pool.lock);
+    free(threads);
+    free(pool.done);
+    free(pool.results);
+    free(pool.outputs);
+    return failures;
+}
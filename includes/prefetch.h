@@ -0,0 +1,340 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include "nm.h"
+
+#define PREFETCH_BATCH 64     // Files opened and stat'ed per submission
+#define PREFETCH_BATCHES 2    // Batches in flight: the one being consumed and the next one
+#define PREFETCH_MIN_FILES 16 // Fewer files are opened by their jobs, the ring is not worth setting up
+
+#define PREFETCH_OPEN 0
+#define PREFETCH_STAT 1
+
+// Minimal io_uring submission and completion rings, set up with the raw system calls
+typedef struct Uring
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring; // Same mapping as sq_ring on kernels with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned queued; // Entries filled since the last submission
+} Uring;
+
+// Result of the batched open and stat of one file
+typedef struct OpenedFile
+{
+    int fd;         // -1 if the file could not be opened, or once it is taken
+    int error;      // errno of the open, 0 if it succeeded
+    bool stated;    // Whether stats holds the statx result
+    char pending;   // Operations of the file still in flight
+    struct stat stats;
+    struct statx statx;
+} OpenedFile;
+
+// Opens and stats the files of a run ahead of the jobs processing them
+struct Prefetch
+{
+    pthread_mutex_t lock;
+    char **files;
+    size_t count;
+    OpenedFile *opened;
+    size_t submitted; // Files whose operations are submitted
+    Uring ring;
+};
+
+/**
+ * Sets up an io_uring instance and maps its rings.
+ *
+ * @param ring The ring to set up.
+ * @param entries The number of submission entries.
+ * @return 1 if the ring is usable, 0 if io_uring is unavailable.
+ */
+int uring_init(Uring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+
+    // Completions of the batches nobody waited for yet pile up, leave them room
+    be_zero(ring, sizeof(Uring));
+    be_zero(&params, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 8;
+    if ((ring->fd = syscall(__NR_io_uring_setup, entries, &params)) < 0)
+        return 0;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP && ring->cq_ring_size > ring->sq_ring_size)
+        ring->sq_ring_size = ring->cq_ring_size;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = params.features & IORING_FEAT_SINGLE_MMAP
+                        ? ring->sq_ring
+                        : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                               IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        if (ring->sq_ring != MAP_FAILED)
+            munmap(ring->sq_ring, ring->sq_ring_size);
+        if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        if (ring->sqes != MAP_FAILED)
+            munmap(ring->sqes, ring->sqes_size);
+        close(ring->fd);
+        return 0;
+    }
+    ring->sq_head = (unsigned *)((char *)ring->sq_ring + params.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring + params.cq_off.cqes);
+    return 1;
+}
+
+/**
+ * Unmaps the rings of an io_uring instance and closes it.
+ *
+ * @param ring The ring to release.
+ */
+void uring_free(Uring *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+/**
+ * Returns the next free submission entry, cleared. The caller makes sure the
+ * ring has room: it never has more operations in flight than entries.
+ *
+ * @param ring The ring.
+ * @return The entry to fill.
+ */
+struct io_uring_sqe *uring_next_entry(Uring *ring)
+{
+    unsigned tail = *ring->sq_tail + ring->queued++;
+    unsigned index = tail & *ring->sq_mask;
+
+    ring->sq_array[index] = index;
+    be_zero(&ring->sqes[index], sizeof(struct io_uring_sqe));
+    return &ring->sqes[index];
+}
+
+/**
+ * Publishes the filled entries to the kernel and optionally waits for completions.
+ *
+ * @param ring The ring.
+ * @param wait The number of completions to wait for.
+ * @return 1 on success, 0 if the kernel refused the submission.
+ */
+int uring_submit(Uring *ring, unsigned wait)
+{
+    long submitted;
+
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->queued, __ATOMIC_RELEASE);
+    do
+        submitted = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait, wait ? IORING_ENTER_GETEVENTS : 0,
+                            NULL, 0);
+    while (submitted < 0 && errno == EINTR);
+    if (submitted < 0)
+        return 0;
+    ring->queued -= submitted;
+    return 1;
+}
+
+/**
+ * Records one completed operation of the prefetch. A completed open queues
+ * the stat of the descriptor it returned, so that the stat describes the file
+ * that is read even if the path is replaced meanwhile. The caller holds the lock.
+ *
+ * @param prefetch The prefetch.
+ * @param cqe The completion.
+ * @return The number of operations queued in its place, 1 for a stat, 0 otherwise.
+ */
+int prefetch_complete(Prefetch *prefetch, struct io_uring_cqe *cqe)
+{
+    OpenedFile *opened = &prefetch->opened[cqe->user_data >> 1];
+    struct statx *status = &opened->statx;
+    struct io_uring_sqe *sqe;
+
+    opened->pending--;
+    if ((cqe->user_data & 1) == PREFETCH_OPEN)
+    {
+        opened->fd = cqe->res >= 0 ? cqe->res : -1;
+        opened->error = cqe->res >= 0 ? 0 : -cqe->res;
+        if (opened->fd < 0)
+            return 0;
+        sqe = uring_next_entry(&prefetch->ring);
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = opened->fd;
+        sqe->addr = (uintptr_t)"";
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = (uintptr_t)status;
+        sqe->statx_flags = AT_EMPTY_PATH | AT_STATX_SYNC_AS_STAT;
+        sqe->user_data = cqe->user_data | PREFETCH_STAT;
+        opened->pending++;
+        return 1;
+    }
+    if (cqe->res >= 0)
+    {
+        // Only the fields read by get_file_data and the cache key are converted
+        opened->stats.st_dev = makedev(status->stx_dev_major, status->stx_dev_minor);
+        opened->stats.st_ino = status->stx_ino;
+        opened->stats.st_mode = status->stx_mode;
+        opened->stats.st_size = status->stx_size;
+        opened->stats.st_mtim.tv_sec = status->stx_mtime.tv_sec;
+        opened->stats.st_mtim.tv_nsec = status->stx_mtime.tv_nsec;
+        opened->stated = true;
+    }
+    return 0;
+}
+
+/**
+ * Submits the opens of the next batch of files, without waiting for them;
+ * their stats follow as the opens complete. The caller holds the lock.
+ *
+ * @param prefetch The prefetch.
+ * @return 1 if the batch is submitted, 0 if the kernel refused it.
+ */
+int prefetch_submit_batch(Prefetch *prefetch)
+{
+    struct io_uring_sqe *sqe;
+    size_t end = prefetch->submitted + PREFETCH_BATCH;
+
+    for (size_t n = prefetch->submitted; n < end && n < prefetch->count; n++)
+    {
+        sqe = uring_next_entry(&prefetch->ring);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t)prefetch->files[n];
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = n << 1 | PREFETCH_OPEN;
+        prefetch->opened[n].pending = 1;
+    }
+    prefetch->submitted = end < prefetch->count ? end : prefetch->count;
+    return uring_submit(&prefetch->ring, 0);
+}
+
+/**
+ * Starts the batched open and stat of the files of a run on an io_uring.
+ *
+ * @param prefetch The prefetch to set up.
+ * @param files The files of the run.
+ * @param count The number of files.
+ * @return 1 if the files are prefetched, 0 if they have to be opened by their jobs.
+ */
+int prefetch_init(Prefetch *prefetch, char **files, size_t count)
+{
+    be_zero(prefetch, sizeof(Prefetch));
+    if (count < PREFETCH_MIN_FILES || !(prefetch->opened = calloc(count, sizeof(OpenedFile))))
+        return 0;
+    if (!uring_init(&prefetch->ring, PREFETCH_BATCH * PREFETCH_BATCHES * 2))
+    {
+        free(prefetch->opened);
+        return 0;
+    }
+    for (size_t n = 0; n < count; n++)
+        prefetch->opened[n].fd = -1;
+    prefetch->files = files;
+    prefetch->count = count;
+    pthread_mutex_init(&prefetch->lock, NULL);
+    return 1;
+}
+
+/**
+ * Takes the open descriptor and the stat of a file, waiting for its batch to
+ * complete. The batch after it is submitted first, so its metadata is fetched
+ * while the files of this one are processed. Files whose operations could not
+ * be submitted are opened by their job.
+ *
+ * @param prefetch The prefetch.
+ * @param index The index of the file.
+ * @param opened Receives the descriptor, now owned by the caller, and the stat.
+ * @return 1 if the file was prefetched, 0 if the job has to open it.
+ */
+int prefetch_take(Prefetch *prefetch, size_t index, OpenedFile *opened)
+{
+    Uring *ring = &prefetch->ring;
+    unsigned head;
+    bool ok = true;
+
+    pthread_mutex_lock(&prefetch->lock);
+    while (ok && prefetch->submitted < prefetch->count &&
+           prefetch->submitted < (index / PREFETCH_BATCH + PREFETCH_BATCHES) * PREFETCH_BATCH)
+        ok = prefetch_submit_batch(prefetch);
+    while (ok && index < prefetch->submitted && prefetch->opened[index].pending)
+    {
+        head = *ring->cq_head;
+        if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            ok = uring_submit(ring, 1);
+            continue;
+        }
+        prefetch_complete(prefetch, &ring->cqes[head & *ring->cq_mask]);
+        __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    }
+    ok = ok && index < prefetch->submitted;
+    if (ok)
+    {
+        *opened = prefetch->opened[index];
+        prefetch->opened[index].fd = -1;
+    }
+    pthread_mutex_unlock(&prefetch->lock);
+    return ok;
+}
+
+/**
+ * Waits for the operations still in flight, closes the descriptors no job
+ * took and releases the ring.
+ *
+ * @param prefetch The prefetch to release.
+ */
+void prefetch_free(Prefetch *prefetch)
+{
+    Uring *ring = &prefetch->ring;
+    size_t pending = 0;
+    unsigned head;
+
+    for (size_t n = 0; n < prefetch->submitted; n++)
+        pending += prefetch->opened[n].pending;
+    while (pending)
+    {
+        head = *ring->cq_head;
+        if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            if (!uring_submit(ring, 1))
+                break;
+            continue;
+        }
+        pending += prefetch_complete(prefetch, &ring->cqes[head & *ring->cq_mask]);
+        __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+        pending--;
+    }
+    for (size_t n = 0; n < prefetch->submitted; n++)
+        if (prefetch->opened[n].fd >= 0)
+            close(prefetch->opened[n].fd);
+    uring_free(ring);
+    pthread_mutex_destroy(&prefetch->lock);
+    free(prefetch->opened);
+}
@@ -0,0 +1,602 @@
+#pragma once
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "nm.h"
+#include "sort.h"
+#include "lookup.h"
+#include "demangle.h"
+#include "file_data.h"
+
+// Requests and responses are frames: a 32-bit length in host byte order, then
+// that many bytes. A request holds NUL-separated fields: the command ("list",
+// "name" or "addr"), the flags ("-D", "-gr", ... or empty), the path and, for
+// "name" and "addr", the symbol name or the addresses. A response holds a
+// status byte, SERVE_OK or SERVE_ERROR, then the text nm would print.
+
+#define SERVE_DEFAULT_BUDGET ((uint64_t)256 << 20)
+#define SERVE_MAX_REQUEST (1 << 20) // Largest request frame accepted, the addresses of one lookup included
+#define SERVE_BACKLOG 64
+#define SERVE_SYMBOL_COST 40 // Bytes held per symbol: its table entry, the demangled pointer and the lookup index
+
+#define SERVE_OK 0
+#define SERVE_ERROR 1
+
+// Flags an entry is read with, one entry per path and combination
+#define SERVE_DYNAMIC 0x01
+#define SERVE_ALL 0x02
+#define SERVE_GLOBALS 0x04
+#define SERVE_UNDEFINED 0x08
+#define SERVE_REVERSE 0x10
+#define SERVE_LOOKUP 0x20 // Defined symbols and their address index, for "addr"
+
+typedef struct ServeEntry ServeEntry;
+
+// A file kept mapped with its symbols sorted, or indexed by address for lookups
+struct ServeEntry
+{
+    char *path;
+    unsigned flags;
+    struct stat identity; // Device, inode, size and mtime of the file when it was read
+    File file;
+    LookupIndex index;    // Built for SERVE_LOOKUP entries only
+    size_t cost;          // Bytes charged to the memory budget
+    size_t references;    // Requests using the entry
+    bool evicted;         // Out of the cache, released by its last request
+    ServeEntry *newer;
+    ServeEntry *older;
+};
+
+// Files most recently used first, kept while their cost fits in the budget
+typedef struct Server
+{
+    Options options; // Command line options applying to every request: -C, --collate and -j
+    uint64_t used;
+    ServeEntry *newest;
+    ServeEntry *oldest;
+    pthread_mutex_t lock;
+} Server;
+
+typedef struct ServeClient
+{
+    Server *server;
+    int fd;
+} ServeClient;
+
+/**
+ * Checks whether the file at a path is still the one an entry was read from.
+ *
+ * @param identity The stat of the file when the entry was read.
+ * @param current The stat of the file now.
+ * @return true if neither the inode nor the contents changed, false otherwise.
+ */
+bool serve_same_file(struct stat *identity, struct stat *current)
+{
+    return identity->st_dev == current->st_dev && identity->st_ino == current->st_ino &&
+           identity->st_size == current->st_size && identity->st_mtim.tv_sec == current->st_mtim.tv_sec &&
+           identity->st_mtim.tv_nsec == current->st_mtim.tv_nsec;
+}
+
+/**
+ * Parses the flags field of a request.
+ *
+ * @param text The flags, with or without a leading '-'.
+ * @param flags Receives the SERVE_* flags.
+ * @return 1 if every flag is known, 0 otherwise.
+ */
+int serve_parse_flags(char *text, unsigned *flags)
+{
+    *flags = 0;
+    if (*text == '-')
+        text++;
+    for (; *text; text++)
+    {
+        if (*text == 'D')
+            *flags |= SERVE_DYNAMIC;
+        else if (*text == 'a')
+            *flags |= SERVE_ALL;
+        else if (*text == 'g')
+            *flags |= SERVE_GLOBALS;
+        else if (*text == 'u')
+            *flags |= SERVE_UNDEFINED;
+        else if (*text == 'r')
+            *flags |= SERVE_REVERSE;
+        else
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Builds the options an entry is read with from the server's and its flags.
+ *
+ * @param base The options of the server.
+ * @param flags The SERVE_* flags of the entry.
+ * @return The options.
+ */
+Options serve_options(Options base, unsigned flags)
+{
+    Options options = base;
+
+    options.dynamic = !!(flags & SERVE_DYNAMIC);
+    options.all = !!(flags & SERVE_ALL);
+    options.globals = !!(flags & SERVE_GLOBALS);
+    options.undefined = !!(flags & SERVE_UNDEFINED);
+    options.reverse = !!(flags & SERVE_REVERSE);
+    options.lookup = !!(flags & SERVE_LOOKUP);
+    options.not_sorted = 0;
+    options.find.pattern = NULL;
+    options.lookup_addresses = NULL;
+    options.lookup_count = 0;
+    return options;
+}
+
+/**
+ * Releases an entry: its symbols, its index, its tables and its mapping.
+ *
+ * @param entry The entry, or NULL.
+ */
+void serve_free_entry(ServeEntry *entry)
+{
+    if (!entry)
+        return;
+    free_symbol_table(&entry->file.symbols);
+    free_lookup_index(&entry->index);
+    free_file_tables(&entry->file);
+    if (entry->file.elf_header)
+        munmap(entry->file.elf_header, entry->file.file_size);
+    free(entry->path);
+    free(entry);
+}
+
+/**
+ * Reads a file into a new entry: maps it, extracts its symbols, demangles
+ * them with -C, then sorts them, or indexes them by address for lookups,
+ * whose names are demangled as they are printed.
+ * The entry's identity is the stat of the descriptor actually mapped.
+ *
+ * @param options The options of the server.
+ * @param path The path of the file.
+ * @param flags The SERVE_* flags of the entry.
+ * @param errors The output errors are appended to.
+ * @return The entry, or NULL if the file could not be read.
+ */
+ServeEntry *serve_load(Options options, char *path, unsigned flags, Output *errors)
+{
+    ServeEntry *entry;
+    OpenedFile opened = {0};
+    Stats stats = {0};
+    File *file;
+    int read;
+
+    options = serve_options(options, flags);
+    if (!(entry = calloc(1, sizeof(ServeEntry))) || !(entry->path = strdup(path)))
+    {
+        free(entry);
+        return NULL;
+    }
+    entry->flags = flags;
+    file = &entry->file;
+    file->output = errors;
+    file->stats = &stats;
+
+    // Only regular files are served, a stream has no identity to check later requests against
+    opened.fd = open(path, O_RDONLY);
+    opened.stated = opened.fd >= 0 && !fstat(opened.fd, &opened.stats);
+    if (!opened.stated || !S_ISREG(opened.stats.st_mode))
+    {
+        if (opened.fd >= 0)
+            close(opened.fd);
+        if (!opened.stated)
+            file_errors(errors, ": '", path, ":' No such file\n");
+        else
+            file_errors(errors, ": Warning: '", path, "' is not an ordinary file\n");
+        serve_free_entry(entry);
+        return NULL;
+    }
+    entry->identity = opened.stats;
+    read = get_file_data(file, path, &opened);
+    if (read && file->file_type == ARCHIVE)
+        read = file_errors(errors, ": ", path, ": archives are not served\n");
+    read = read && file->reader->check_file_data(file, path, options) &&
+           (file->symbol_table || file_errors(errors, ": ", path, ": no symbols\n")) &&
+           file->reader->get_symbols(file, options) &&
+           (!options.demangle || options.lookup || demangle_symbols(file, options.demangle, options.jobs));
+    if (read && options.lookup)
+        read = build_lookup_index(&entry->index, file);
+    else if (read)
+        sort_symbols(file, options);
+    file->output = NULL;
+    file->stats = NULL;
+    if (!read)
+    {
+        serve_free_entry(entry);
+        return NULL;
+    }
+    entry->cost = sizeof(ServeEntry) + stats.bytes_mapped + file->symbols.count * SERVE_SYMBOL_COST +
+                  file->section_count * sizeof(Section) + file->version_count * sizeof(Version);
+    return entry;
+}
+
+/**
+ * Removes an entry from the recency list. The caller holds the server lock.
+ *
+ * @param server The server.
+ * @param entry The entry.
+ */
+void serve_detach(Server *server, ServeEntry *entry)
+{
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        server->newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        server->oldest = entry->newer;
+}
+
+/**
+ * Takes an entry out of the cache. The caller holds the server lock.
+ *
+ * @param server The server.
+ * @param entry The entry, freed at once unless a request still uses it.
+ */
+void serve_unlink(Server *server, ServeEntry *entry)
+{
+    serve_detach(server, entry);
+    server->used -= entry->cost;
+    entry->evicted = true;
+    if (!entry->references)
+        serve_free_entry(entry);
+}
+
+/**
+ * Puts an entry first in the cache. The caller holds the server lock.
+ *
+ * @param server The server.
+ * @param entry The entry, out of the cache.
+ */
+void serve_push(Server *server, ServeEntry *entry)
+{
+    entry->older = server->newest;
+    entry->newer = NULL;
+    if (server->newest)
+        server->newest->newer = entry;
+    else
+        server->oldest = entry;
+    server->newest = entry;
+}
+
+/**
+ * Finds the entry of a path and flags. The caller holds the server lock.
+ *
+ * @param server The server.
+ * @param path The path of the file.
+ * @param flags The SERVE_* flags of the entry.
+ * @return The entry, or NULL if the file is not cached with these flags.
+ */
+ServeEntry *serve_find(Server *server, char *path, unsigned flags)
+{
+    for (ServeEntry *entry = server->newest; entry; entry = entry->older)
+        if (entry->flags == flags && !string_compare(entry->path, path))
+            return entry;
+    return NULL;
+}
+
+/**
+ * Returns the entry of a file for a request, reading the file when it is not
+ * cached or changed since it was. Files are read outside the server lock, so
+ * that other requests are answered meanwhile; the least recently used entries
+ * are then evicted until the cache fits in its budget again.
+ *
+ * @param server The server.
+ * @param path The path of the file.
+ * @param flags The SERVE_* flags of the entry.
+ * @param errors The output errors are appended to.
+ * @return The entry, referenced until serve_release, or NULL if the file could not be read.
+ */
+ServeEntry *serve_acquire(Server *server, char *path, unsigned flags, Output *errors)
+{
+    ServeEntry *entry;
+    ServeEntry *loaded;
+    struct stat current;
+    bool exists = !stat(path, &current);
+
+    pthread_mutex_lock(&server->lock);
+    if ((entry = serve_find(server, path, flags)) && (!exists || !serve_same_file(&entry->identity, &current)))
+    {
+        serve_unlink(server, entry);
+        entry = NULL;
+    }
+    if (entry)
+    {
+        entry->references++;
+        serve_detach(server, entry);
+        serve_push(server, entry);
+    }
+    pthread_mutex_unlock(&server->lock);
+    if (entry)
+        return entry;
+
+    if (!(loaded = serve_load(server->options, path, flags, errors)))
+        return NULL;
+
+    // Another request may have read the same file meanwhile, the entry read first stays
+    pthread_mutex_lock(&server->lock);
+    if ((entry = serve_find(server, path, flags)) && serve_same_file(&entry->identity, &loaded->identity))
+        serve_free_entry(loaded);
+    else
+    {
+        if (entry)
+            serve_unlink(server, entry);
+        entry = loaded;
+        server->used += entry->cost;
+        serve_push(server, entry);
+    }
+    entry->references++;
+    while (server->used > server->options.serve_budget && server->oldest != entry)
+        serve_unlink(server, server->oldest);
+    pthread_mutex_unlock(&server->lock);
+    return entry;
+}
+
+/**
+ * Ends the use of an entry by a request, freeing it if it was evicted meanwhile.
+ *
+ * @param server The server.
+ * @param entry The entry.
+ */
+void serve_release(Server *server, ServeEntry *entry)
+{
+    bool release;
+
+    pthread_mutex_lock(&server->lock);
+    release = !--entry->references && entry->evicted;
+    pthread_mutex_unlock(&server->lock);
+    if (release)
+        serve_free_entry(entry);
+}
+
+/**
+ * Prints the symbols of an entry named exactly as given, found by binary
+ * search in the sorted order, or by a scan when it follows the locale's collation.
+ *
+ * @param file The file of the entry, printing to the response.
+ * @param options The options the entry was read with.
+ * @param name The name searched.
+ */
+void serve_print_name(File *file, Options options, char *name)
+{
+    int direction = options.reverse ? -1 : 1;
+    uint32_t *order = file->symbols.order;
+    size_t low = 0;
+    size_t high = options.collate ? 0 : file->symbols.count;
+    size_t middle;
+
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (direction * string_compare(get_symbol_name(file, order[middle]), name) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    for (size_t n = low; n < file->symbols.count; n++)
+    {
+        if (!string_compare(get_symbol_name(file, order[n]), name))
+            print_symbol(file, get_symbol(file, order[n]));
+        else if (!options.collate)
+            break;
+    }
+}
+
+/**
+ * Answers one request into a response.
+ *
+ * @param server The server.
+ * @param request The fields of the request.
+ * @param length The length of the request.
+ * @param response The output the answer, or the errors, are appended to.
+ * @return SERVE_OK if the request was answered, SERVE_ERROR otherwise.
+ */
+int serve_request(Server *server, char *request, size_t length, Output *response)
+{
+    char *fields[4] = {NULL};
+    size_t count = 0;
+    unsigned flags;
+    ServeEntry *entry;
+    Options lookups = {0};
+    File file;
+    int result = 1;
+
+    // The last field may go without its NUL
+    request[length] = '\0';
+    for (size_t n = 0; n < length && count < 4; n += string_length(request + n) + 1)
+        fields[count++] = request + n;
+    if (count < 3 || !serve_parse_flags(fields[1], &flags) ||
+        (string_compare(fields[0], "list") && count < 4))
+    {
+        file_errors(response, ": ", "request", ": malformed\n");
+        return SERVE_ERROR;
+    }
+    if (!string_compare(fields[0], "addr"))
+    {
+        flags = (flags & (SERVE_DYNAMIC | SERVE_GLOBALS)) | SERVE_LOOKUP;
+        if (!parse_lookup_addresses(&lookups, fields[3], string_length(fields[3])))
+        {
+            free(lookups.lookup_addresses);
+            file_errors(response, ": ", fields[3], ": invalid address\n");
+            return SERVE_ERROR;
+        }
+    }
+    else if (string_compare(fields[0], "list") && string_compare(fields[0], "name"))
+    {
+        file_errors(response, ": ", fields[0], ": unknown request\n");
+        return SERVE_ERROR;
+    }
+    if (!(entry = serve_acquire(server, fields[2], flags, response)))
+    {
+        free(lookups.lookup_addresses);
+        return SERVE_ERROR;
+    }
+
+    // Requests print through their own copy of the file, only the response differs
+    file = entry->file;
+    file.output = response;
+    if (flags & SERVE_LOOKUP)
+    {
+        lookups.demangle = server->options.demangle;
+        result = resolve_lookups(&file, &entry->index, lookups);
+    }
+    else if (!string_compare(fields[0], "name"))
+        serve_print_name(&file, serve_options(server->options, flags), fields[3]);
+    else
+        print_symbols(&file, 1);
+    serve_release(server, entry);
+    free(lookups.lookup_addresses);
+    return result ? SERVE_OK : SERVE_ERROR;
+}
+
+/**
+ * Reads exactly a number of bytes from a connection.
+ *
+ * @param fd The connection.
+ * @param buffer The buffer receiving the bytes.
+ * @param length The number of bytes.
+ * @return 1 if every byte was read, 0 at the end of the connection or on an error.
+ */
+int serve_read(int fd, void *buffer, size_t length)
+{
+    ssize_t got;
+
+    while (length)
+    {
+        got = read(fd, buffer, length);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 0;
+        buffer = (char *)buffer + got;
+        length -= got;
+    }
+    return 1;
+}
+
+/**
+ * Thread routine answering the requests of one client until it disconnects.
+ *
+ * @param argument The ServeClient, released when the client is done.
+ * @return NULL.
+ */
+void *serve_client_thread(void *argument)
+{
+    ServeClient *client = argument;
+    Output response;
+    uint32_t length;
+    char *request;
+    char status;
+    bool open = output_init_memory(&response);
+
+    while (open && serve_read(client->fd, &length, sizeof(length)) && length <= SERVE_MAX_REQUEST &&
+           (request = malloc(length + 1)))
+    {
+        // The frame length and status are written in front of the answer once it is known
+        response.length = 0;
+        output_fill(&response, '\0', sizeof(uint32_t) + 1);
+        if ((open = serve_read(client->fd, request, length)))
+        {
+            status = serve_request(client->server, request, length, &response);
+            length = response.length - sizeof(uint32_t);
+            memcpy(response.buffer, &length, sizeof(uint32_t));
+            response.buffer[sizeof(uint32_t)] = status;
+            open = write_all(client->fd, response.buffer, response.length);
+        }
+        free(request);
+    }
+    output_release(&response);
+    close(client->fd);
+    free(client);
+    return NULL;
+}
+
+/**
+ * Binds a socket to its path. A socket file left by a server that is gone is
+ * replaced; a live server, or anything else at the path, makes it fail.
+ *
+ * @param listener The socket.
+ * @param address The address holding the path.
+ * @return 1 if the socket is bound, 0 otherwise.
+ */
+int serve_bind(int listener, struct sockaddr_un *address)
+{
+    int probe;
+    bool stale;
+
+    if (!bind(listener, (struct sockaddr *)address, sizeof(*address)))
+        return 1;
+    if (errno != EADDRINUSE || (probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return 0;
+    stale = connect(probe, (struct sockaddr *)address, sizeof(*address)) && errno == ECONNREFUSED;
+    close(probe);
+    return stale && !unlink(address->sun_path) && !bind(listener, (struct sockaddr *)address, sizeof(*address));
+}
+
+/**
+ * Serves symbol queries on a Unix domain socket until the server fails. Each
+ * client gets its own thread; files stay mapped with their symbols sorted
+ * between requests, in a cache bounded by --serve-memory, and are read again
+ * when their inode, size or mtime changes.
+ *
+ * @param options The command line options, serve_socket naming the socket.
+ * @param output The output errors are appended to.
+ * @return 0, once the socket could not be set up or accept failed.
+ */
+int serve(Options options, Output *output)
+{
+    Server server = {.options = options};
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    ServeClient *client;
+    pthread_attr_t attributes;
+    pthread_t thread;
+    int listener;
+    int fd;
+
+    if (string_length(options.serve_socket) >= sizeof(address.sun_path))
+        return file_errors(output, ": ", options.serve_socket, ": socket path too long\n");
+    memcpy(address.sun_path, options.serve_socket, string_length(options.serve_socket) + 1);
+
+    if ((listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 || !serve_bind(listener, &address) ||
+        listen(listener, SERVE_BACKLOG))
+    {
+        if (listener >= 0)
+            close(listener);
+        return file_errors(output, ": ", options.serve_socket, ": cannot listen on socket\n");
+    }
+
+    // Clients that hang up only fail their own write
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    while ((fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC)) >= 0 || errno == EINTR || errno == ECONNABORTED)
+    {
+        if (fd < 0)
+            continue;
+        if (!(client = malloc(sizeof(ServeClient))))
+        {
+            close(fd);
+            continue;
+        }
+        *client = (ServeClient){&server, fd};
+        if (pthread_create(&thread, &attributes, serve_client_thread, client))
+        {
+            close(fd);
+            free(client);
+        }
+    }
+    close(listener);
+    return file_errors(output, ": ", options.serve_socket, ": cannot accept connections\n");
+}
@@ -0,0 +1,531 @@
+#pragma once
+
+#include <locale.h>
+
+#include "nm.h"
+
+#define SORT_INSERTION_THRESHOLD 16
+#define SORT_PARALLEL_THRESHOLD (1 << 16)
+#define SORT_MAX_THREADS PARALLEL_MAX_THREADS
+#define COLLATION_KEY_RESERVE 24 // Initial arena bytes per symbol, keys are usually a few times longer than names
+
+// Locale collation keys of a file's symbols, built once so that the sort never calls strcoll
+typedef struct CollationKeys
+{
+    char *arena;        // Every key, null-terminated, back to back
+    size_t *offsets;    // Offset of each symbol's key in the arena
+    uint64_t *prefixes; // First 8 bytes of each key, big-endian so that they compare as integers
+} CollationKeys;
+
+typedef struct SortContext
+{
+    File *file;
+    bool reverse;
+    bool table_order; // Equal names keep symbol table order, as versions of a dynamic symbol do in GNU nm
+    const CollationKeys *keys; // NULL to compare the bytes of the names
+} SortContext;
+
+typedef struct CollationRun
+{
+    File *file;
+    CollationKeys *keys;
+    size_t start;
+    size_t end;
+    char *arena; // Keys of the run, offsets are relative to it until the arenas are joined
+    size_t used;
+    bool failed;
+} CollationRun;
+
+typedef struct SortRun
+{
+    uint32_t *symbols;
+    uint32_t *buffer;
+    size_t count;
+    size_t middle;
+    const SortContext *context;
+} SortRun;
+
+/**
+ * Compares two symbols by name, then by value, then by their index in the symbol table.
+ * Names are compared on their collation keys when the context has them, the
+ * cached prefixes first and the rest of the keys only when the prefixes tie.
+ * With table_order, equal names go straight to the index, whatever the direction.
+ *
+ * @param context The file the symbols belong to and the sort direction.
+ * @param a The index of the first symbol.
+ * @param b The index of the second symbol.
+ * @return A negative value if a goes before b, a positive value if it goes after, 0 if they are the same symbol.
+ */
+int compare_symbols(const SortContext *context, uint32_t a, uint32_t b)
+{
+    int result;
+    uint64_t *values = context->file->symbols.values;
+    const CollationKeys *keys = context->keys;
+
+    if (keys)
+    {
+        result = (keys->prefixes[a] > keys->prefixes[b]) - (keys->prefixes[a] < keys->prefixes[b]);
+
+        // Equal prefixes whose last byte is set belong to keys of at least 8 bytes
+        if (!result && keys->prefixes[a] & 0xff)
+            result = strcmp(keys->arena + keys->offsets[a] + 8, keys->arena + keys->offsets[b] + 8);
+    }
+    else
+        result = string_compare(get_symbol_name(context->file, a), get_symbol_name(context->file, b));
+    if (!result && context->table_order)
+        return (a > b) - (a < b);
+    if (!result)
+        result = (values[a] > values[b]) - (values[a] < values[b]);
+    if (!result)
+        result = (a > b) - (a < b);
+    return context->reverse ? -result : result;
+}
+
+/**
+ * Swaps two symbol indexes in place.
+ *
+ * @param a The first index.
+ * @param b The second index.
+ */
+void swap_symbols(uint32_t *a, uint32_t *b)
+{
+    uint32_t tempSymbol;
+
+    tempSymbol = *a;
+    *a = *b;
+    *b = tempSymbol;
+}
+
+/**
+ * Sorts a small array of symbols with insertion sort.
+ *
+ * @param symbols The array of symbol indexes to be sorted.
+ * @param len The number of symbols in the array.
+ * @param context The file the symbols belong to and the sort direction.
+ */
+void insertion_sort_symbols(uint32_t *symbols, size_t len, const SortContext *context)
+{
+    uint32_t tempSymbol;
+    size_t j;
+
+    for (size_t i = 1; i < len; i++)
+    {
+        tempSymbol = symbols[i];
+        j = i;
+        while (j > 0 && compare_symbols(context, tempSymbol, symbols[j - 1]) < 0)
+        {
+            symbols[j] = symbols[j - 1];
+            j--;
+        }
+        symbols[j] = tempSymbol;
+    }
+}
+
+/**
+ * Moves a symbol down a max-heap until the heap property holds again.
+ *
+ * @param symbols The heap.
+ * @param root The index of the symbol to move down.
+ * @param len The number of symbols in the heap.
+ * @param context The file the symbols belong to and the sort direction.
+ */
+void sift_down_symbols(uint32_t *symbols, size_t root, size_t len, const SortContext *context)
+{
+    size_t child;
+
+    while ((child = 2 * root + 1) < len)
+    {
+        if (child + 1 < len && compare_symbols(context, symbols[child], symbols[child + 1]) < 0)
+            child++;
+        if (compare_symbols(context, symbols[root], symbols[child]) >= 0)
+            return;
+        swap_symbols(&symbols[root], &symbols[child]);
+        root = child;
+    }
+}
+
+/**
+ * Sorts an array of symbols with heapsort, used when quicksort degenerates.
+ *
+ * @param symbols The array of symbol indexes to be sorted.
+ * @param len The number of symbols in the array.
+ * @param context The file the symbols belong to and the sort direction.
+ */
+void heapsort_symbols(uint32_t *symbols, size_t len, const SortContext *context)
+{
+    size_t n;
+
+    // Build the heap bottom-up
+    for (n = len / 2; n > 0; n--)
+        sift_down_symbols(symbols, n - 1, len, context);
+
+    // Move the largest symbol to the end of the array one at a time
+    for (n = len; n > 1; n--)
+    {
+        swap_symbols(&symbols[0], &symbols[n - 1]);
+        sift_down_symbols(symbols, 0, n - 1, context);
+    }
+}
+
+/**
+ * Orders the first, middle and last symbols and moves the median to the end as the pivot.
+ *
+ * @param symbols The array of symbols to be partitioned.
+ * @param len The number of symbols in the array.
+ * @param context The file the symbols belong to and the sort direction.
+ */
+void median_of_three_symbols(uint32_t *symbols, size_t len, const SortContext *context)
+{
+    uint32_t *first = &symbols[0];
+    uint32_t *middle = &symbols[len / 2];
+    uint32_t *last = &symbols[len - 1];
+
+    if (compare_symbols(context, *middle, *first) < 0)
+        swap_symbols(middle, first);
+    if (compare_symbols(context, *last, *first) < 0)
+        swap_symbols(last, first);
+    if (compare_symbols(context, *last, *middle) < 0)
+        swap_symbols(last, middle);
+
+    // The median becomes the pivot at the end of the array
+    swap_symbols(middle, last);
+}
+
+/**
+ * Sorts an array of symbols with introsort: quicksort with a median-of-three pivot,
+ * falling back to heapsort past a depth limit and to insertion sort on small ranges.
+ *
+ * @param symbols The array of symbol indexes to be sorted.
+ * @param len The number of symbols in the array.
+ * @param depth The number of partitioning levels left before falling back to heapsort.
+ * @param context The file the symbols belong to and the sort direction.
+ */
+void introsort_symbols(uint32_t *symbols, size_t len, int depth, const SortContext *context)
+{
+    uint32_t *pivot;
+    size_t currentIndex;
+
+    while (len > SORT_INSERTION_THRESHOLD)
+    {
+        if (depth-- == 0)
+        {
+            heapsort_symbols(symbols, len, context);
+            return;
+        }
+
+        // Partition the array around the median of three symbols
+        median_of_three_symbols(symbols, len, context);
+        pivot = &symbols[len - 1];
+        currentIndex = 0;
+        for (size_t n = 0; n < len - 1; n++)
+        {
+            if (compare_symbols(context, symbols[n], *pivot) < 0)
+                swap_symbols(&symbols[currentIndex++], &symbols[n]);
+        }
+        swap_symbols(&symbols[currentIndex], pivot);
+
+        // Recurse into the smaller side and loop on the larger one to bound the stack
+        if (currentIndex < len - currentIndex - 1)
+        {
+            introsort_symbols(symbols, currentIndex, depth, context);
+            symbols += currentIndex + 1;
+            len -= currentIndex + 1;
+        }
+        else
+        {
+            introsort_symbols(&symbols[currentIndex + 1], len - currentIndex - 1, depth, context);
+            len = currentIndex;
+        }
+    }
+    insertion_sort_symbols(symbols, len, context);
+}
+
+/**
+ * Returns the introsort depth limit for an array, twice the base-2 logarithm of its length.
+ *
+ * @param len The number of symbols in the array.
+ * @return The depth limit.
+ */
+int introsort_depth(size_t len)
+{
+    int depth = 0;
+
+    while (len >>= 1)
+        depth++;
+    return depth * 2;
+}
+
+/**
+ * Thread entry point sorting one run of symbols with introsort.
+ *
+ * @param argument The SortRun to sort.
+ * @return NULL.
+ */
+void *sort_run_thread(void *argument)
+{
+    SortRun *run = argument;
+
+    introsort_symbols(run->symbols, run->count, introsort_depth(run->count), run->context);
+    return NULL;
+}
+
+/**
+ * Thread entry point merging the two sorted halves of a run into its buffer.
+ * Symbols from the left half win ties, so the merge is stable.
+ *
+ * @param argument The SortRun to merge, split at its middle.
+ * @return NULL.
+ */
+void *merge_run_thread(void *argument)
+{
+    SortRun *run = argument;
+    size_t left = 0;
+    size_t right = run->middle;
+    size_t n = 0;
+
+    while (left < run->middle && right < run->count)
+    {
+        if (compare_symbols(run->context, run->symbols[right], run->symbols[left]) < 0)
+            run->buffer[n++] = run->symbols[right++];
+        else
+            run->buffer[n++] = run->symbols[left++];
+    }
+    while (left < run->middle)
+        run->buffer[n++] = run->symbols[left++];
+    while (right < run->count)
+        run->buffer[n++] = run->symbols[right++];
+    return NULL;
+}
+
+/**
+ * Returns the number of threads a parallel sort of the given length should use.
+ *
+ * @param len The number of symbols to sort.
+ * @return A power of two between 1 and SORT_MAX_THREADS.
+ */
+int sort_thread_count(size_t len)
+{
+    long cores;
+    int threads = 1;
+
+    if (len < SORT_PARALLEL_THRESHOLD)
+        return 1;
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+    while (threads * 2 <= cores && threads * 2 <= SORT_MAX_THREADS && len / (threads * 2) >= SORT_PARALLEL_THRESHOLD / 2)
+        threads *= 2;
+    return threads;
+}
+
+/**
+ * Sorts an array of symbols with a multi-threaded merge sort: every thread introsorts
+ * one run, then pairs of runs are merged in parallel until a single run is left.
+ *
+ * @param symbols The array of symbol indexes to be sorted.
+ * @param len The number of symbols in the array.
+ * @param threads The number of runs, a power of two.
+ * @param context The file the symbols belong to and the sort direction.
+ * @return 1 if the array was sorted, 0 if the merge buffer could not be allocated.
+ */
+int parallel_merge_sort_symbols(uint32_t *symbols, size_t len, int threads, const SortContext *context)
+{
+    SortRun runs[SORT_MAX_THREADS];
+    size_t bounds[SORT_MAX_THREADS + 1];
+    uint32_t *buffer;
+    uint32_t *swap;
+    bool inBuffer = false;
+
+    if (!(buffer = memory_allocate(context->file->allocator, sizeof(uint32_t) * len)))
+        return 0;
+
+    // Sort every run on its own thread
+    for (int n = 0; n <= threads; n++)
+        bounds[n] = len * n / threads;
+    for (int n = 0; n < threads; n++)
+        runs[n] = (SortRun){&symbols[bounds[n]], NULL, bounds[n + 1] - bounds[n], 0, context};
+    run_threads(sort_run_thread, runs, sizeof(SortRun), threads);
+
+    // Merge neighbouring runs pairwise, ping-ponging between the array and the buffer
+    for (int width = 1; width < threads; width *= 2)
+    {
+        int merges = 0;
+        for (int n = 0; n < threads; n += width * 2)
+        {
+            runs[merges++] = (SortRun){&symbols[bounds[n]], &buffer[bounds[n]],
+                                       bounds[n + width * 2] - bounds[n], bounds[n + width] - bounds[n], context};
+        }
+        run_threads(merge_run_thread, runs, sizeof(SortRun), merges);
+        swap = symbols;
+        symbols = buffer;
+        buffer = swap;
+        inBuffer = !inBuffer;
+    }
+
+    // An odd number of merge levels leaves the result in the buffer
+    if (inBuffer)
+    {
+        memcpy(buffer, symbols, sizeof(uint32_t) * len);
+        memory_release(context->file->allocator, symbols);
+    }
+    else
+        memory_release(context->file->allocator, buffer);
+    return 1;
+}
+
+/**
+ * Packs the first 8 bytes of a collation key into an integer, big-endian and
+ * zero-padded, so that comparing prefixes orders keys as strcmp would.
+ *
+ * @param key The null-terminated key.
+ * @return The prefix of the key.
+ */
+uint64_t collation_prefix(const char *key)
+{
+    uint64_t prefix = 0;
+    bool ended = false;
+
+    for (int n = 0; n < 8; n++)
+    {
+        ended = ended || !key[n];
+        prefix = prefix << 8 | (ended ? 0 : (unsigned char)key[n]);
+    }
+    return prefix;
+}
+
+/**
+ * Thread entry point transforming the names of one range of symbols into
+ * collation keys with strxfrm, appended to the arena of the run.
+ *
+ * @param argument The CollationRun to process.
+ * @return NULL.
+ */
+void *collation_run_thread(void *argument)
+{
+    CollationRun *run = argument;
+    size_t capacity = (run->end - run->start) * COLLATION_KEY_RESERVE + 64;
+    size_t length;
+    char *name;
+    char *grown;
+
+    run->failed = !(run->arena = malloc(capacity));
+    if (run->failed)
+        return NULL;
+    for (size_t n = run->start; n < run->end; n++)
+    {
+        // strxfrm reports the full length of a key that does not fit, retry with enough room
+        name = get_symbol_name(run->file, n);
+        while ((length = strxfrm(run->arena + run->used, name, capacity - run->used)) >= capacity - run->used)
+        {
+            capacity = capacity * 2 > run->used + length + 1 ? capacity * 2 : run->used + length + 1;
+            if (!(grown = realloc(run->arena, capacity)))
+            {
+                run->failed = true;
+                return NULL;
+            }
+            run->arena = grown;
+        }
+        run->keys->offsets[n] = run->used;
+        run->keys->prefixes[n] = collation_prefix(run->arena + run->used);
+        run->used += length + 1;
+    }
+    return NULL;
+}
+
+/**
+ * Releases the collation keys of a file.
+ *
+ * @param keys The keys to release.
+ */
+void free_collation_keys(CollationKeys *keys)
+{
+    free(keys->arena);
+    free(keys->offsets);
+    free(keys->prefixes);
+    be_zero(keys, sizeof(CollationKeys));
+}
+
+/**
+ * Builds the collation keys of a file's symbols under the LC_COLLATE locale,
+ * comparing them with strcmp orders the names as strcoll does. Ranges of
+ * symbols are transformed on separate threads into their own arenas, which
+ * are then joined into one.
+ *
+ * @param file The file whose symbol names are transformed.
+ * @param keys The keys to build.
+ * @param threads The number of threads to use, at most SORT_MAX_THREADS.
+ * @return 1 if the keys are built, 0 if memory ran out.
+ */
+int build_collation_keys(File *file, CollationKeys *keys, int threads)
+{
+    CollationRun runs[SORT_MAX_THREADS] = {0};
+    size_t count = file->symbols.count;
+    size_t total = 0;
+    bool failed = false;
+
+    be_zero(keys, sizeof(CollationKeys));
+    keys->offsets = malloc(sizeof(size_t) * (count + 1));
+    keys->prefixes = malloc(sizeof(uint64_t) * (count + 1));
+    if (!keys->offsets || !keys->prefixes)
+    {
+        free_collation_keys(keys);
+        return 0;
+    }
+    for (int n = 0; n < threads; n++)
+        runs[n] = (CollationRun){file, keys, count * n / threads, count * (n + 1) / threads, NULL, 0, false};
+    run_threads(collation_run_thread, runs, sizeof(CollationRun), threads);
+
+    // Append every arena to the first one, shifting the offsets of its keys
+    for (int n = 0; n < threads; n++)
+    {
+        failed = failed || runs[n].failed;
+        total += runs[n].used;
+    }
+    if (!failed && (keys->arena = realloc(runs[0].arena, total + 1)))
+    {
+        runs[0].arena = NULL;
+        for (int n = 1; n < threads; n++)
+        {
+            memcpy(keys->arena + runs[n - 1].used, runs[n].arena, runs[n].used);
+            runs[n].used += runs[n - 1].used;
+            for (size_t symbol = runs[n].start; symbol < runs[n].end; symbol++)
+                keys->offsets[symbol] += runs[n - 1].used;
+        }
+    }
+    for (int n = 0; n < threads; n++)
+        free(runs[n].arena);
+    if (!keys->arena)
+    {
+        free_collation_keys(keys);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Sorts the print order of a file's symbols by name in O(n log n), in parallel
+ * for large tables on up to options.jobs threads. Only the permutation of
+ * symbol indexes is moved around.
+ * With --collate the names are ordered by the locale's collation, as GNU nm
+ * orders them, through keys built before the sort; if they cannot be built
+ * the names are sorted on their bytes.
+ *
+ * @param file The file whose symbols are sorted.
+ * @param options The options selecting the sort order.
+ */
+void sort_symbols(File *file, Options options)
+{
+    int threads;
+    CollationKeys keys;
+    SortContext context = {file, options.reverse, options.dynamic, NULL};
+    uint32_t *symbols = file->symbols.order;
+    size_t len = file->symbols.count;
+
+    threads = sort_thread_count(len);
+    while (options.jobs > 0 && threads > options.jobs)
+        threads /= 2;
+    if (options.collate && build_collation_keys(file, &keys, threads))
+        context.keys = &keys;
+    if (threads == 1 || !parallel_merge_sort_symbols(symbols, len, threads, &context))
+        introsort_symbols(symbols, len, introsort_depth(len), &context);
+    if (context.keys)
+        free_collation_keys(&keys);
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <time.h>
+#include <sys/resource.h>
+
+#include "output.h"
+
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+typedef enum Phase
+{
+    PHASE_MAP,
+    PHASE_CHECK,
+    PHASE_EXTRACT,
+    PHASE_SORT,
+    PHASE_PRINT,
+    PHASE_COUNT
+} Phase;
+
+typedef struct Stats
+{
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t symbols_read;
+    uint64_t symbols_printed;
+    uint64_t bytes_mapped;
+    uint64_t pages_mapped; // Pages mapped readable, read or not; a sparse mapping leaves the rest of the file out
+    uint64_t file_pages;
+    uint64_t output_bytes;
+    uint64_t minor_faults; // Taken by the job thread of a file, the total counts every thread of the run
+    uint64_t major_faults;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+} Stats;
+
+static const char *const phase_names[PHASE_COUNT] = {"map", "check", "extract", "sort", "print"};
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return The current monotonic time in nanoseconds.
+ */
+uint64_t clock_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Starts timing a phase, when statistics are being collected.
+ *
+ * @param stats The statistics being collected, or NULL.
+ * @return The start time of the phase.
+ */
+uint64_t stats_start(Stats *stats)
+{
+    return stats ? clock_ns() : 0;
+}
+
+/**
+ * Adds the time elapsed since `start` to a phase, when statistics are being collected.
+ *
+ * @param stats The statistics being collected, or NULL.
+ * @param phase The phase being timed.
+ * @param start The value returned by stats_start.
+ */
+void stats_stop(Stats *stats, Phase phase, uint64_t start)
+{
+    if (stats)
+        stats->phase_ns[phase] += clock_ns() - start;
+}
+
+/**
+ * Adds the page faults taken by the calling thread since `before` was sampled.
+ * The helper threads a file's extraction, sort or print may start are not
+ * counted; print_stats reports them in the totals of the run.
+ *
+ * @param stats The statistics being collected, or NULL.
+ * @param before The thread usage sampled at the start of the work.
+ */
+void stats_faults(Stats *stats, struct rusage *before)
+{
+    struct rusage after;
+
+    if (!stats || getrusage(RUSAGE_THREAD, &after))
+        return;
+    stats->minor_faults += after.ru_minflt - before->ru_minflt;
+    stats->major_faults += after.ru_majflt - before->ru_majflt;
+}
+
+/**
+ * Adds the counters of one set of statistics to another.
+ *
+ * @param into The statistics receiving the sum.
+ * @param from The statistics to add.
+ */
+void stats_merge(Stats *into, Stats *from)
+{
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+        into->phase_ns[phase] += from->phase_ns[phase];
+    into->symbols_read += from->symbols_read;
+    into->symbols_printed += from->symbols_printed;
+    into->bytes_mapped += from->bytes_mapped;
+    into->pages_mapped += from->pages_mapped;
+    into->file_pages += from->file_pages;
+    into->output_bytes += from->output_bytes;
+    into->minor_faults += from->minor_faults;
+    into->major_faults += from->major_faults;
+    into->cache_hits += from->cache_hits;
+    into->cache_misses += from->cache_misses;
+}
+
+/**
+ * Appends a duration in milliseconds with three decimals.
+ *
+ * @param output The output to append to.
+ * @param ns The duration in nanoseconds.
+ */
+void output_milliseconds(Output *output, uint64_t ns)
+{
+    uint64_t micros = ns / 1000;
+
+    output_decimal(output, micros / 1000);
+    output_char(output, '.');
+    output_char(output, '0' + micros / 100 % 10);
+    output_char(output, '0' + micros / 10 % 10);
+    output_char(output, '0' + micros % 10);
+}
+
+/**
+ * Appends a string as a JSON string literal.
+ *
+ * @param output The output to append to.
+ * @param string The string to quote.
+ */
+void output_json_string(Output *output, const char *string)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    output_char(output, '"');
+    for (; *string; string++)
+    {
+        if (*string == '"' || *string == '\\')
+        {
+            output_char(output, '\\');
+            output_char(output, *string);
+        }
+        else if ((unsigned char)*string < 0x20)
+        {
+            output_write(output, "\\u00", 4);
+            output_char(output, hex[(unsigned char)*string >> 4]);
+            output_char(output, hex[*string & 0xf]);
+        }
+        else
+            output_char(output, *string);
+    }
+    output_char(output, '"');
+}
+
+/**
+ * Appends one set of statistics in the human-readable layout.
+ *
+ * @param output The output to append to.
+ * @param label The file name or "total".
+ * @param stats The statistics to print.
+ */
+void print_stats_text(Output *output, const char *label, Stats *stats)
+{
+    output_string(output, TOOL_NAME ": stats: ");
+    output_string(output, label);
+    output_string(output, ":");
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        output_char(output, ' ');
+        output_string(output, phase_names[phase]);
+        output_char(output, ' ');
+        output_milliseconds(output, stats->phase_ns[phase]);
+        output_string(output, phase + 1 < PHASE_COUNT ? " ms," : " ms;");
+    }
+    output_char(output, ' ');
+    output_decimal(output, stats->symbols_read);
+    output_string(output, " symbols read, ");
+    output_decimal(output, stats->symbols_printed);
+    output_string(output, " printed; ");
+    output_decimal(output, stats->bytes_mapped);
+    output_string(output, " bytes mapped, ");
+    output_decimal(output, stats->pages_mapped);
+    output_char(output, '/');
+    output_decimal(output, stats->file_pages);
+    output_string(output, " pages mapped; ");
+    output_decimal(output, stats->minor_faults);
+    output_string(output, " minor + ");
+    output_decimal(output, stats->major_faults);
+    output_string(output, " major faults; ");
+    output_decimal(output, stats->output_bytes);
+    output_string(output, " bytes output");
+    if (stats->cache_hits || stats->cache_misses)
+    {
+        output_string(output, "; cache ");
+        output_decimal(output, stats->cache_hits);
+        output_string(output, " hits, ");
+        output_decimal(output, stats->cache_misses);
+        output_string(output, " misses");
+    }
+}
+
+/**
+ * Appends the fields of one set of statistics as JSON object members.
+ *
+ * @param output The output to append to.
+ * @param stats The statistics to print.
+ */
+void print_stats_json(Output *output, Stats *stats)
+{
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        output_char(output, '"');
+        output_string(output, phase_names[phase]);
+        output_string(output, "_ns\":");
+        output_decimal(output, stats->phase_ns[phase]);
+        output_char(output, ',');
+    }
+    output_string(output, "\"symbols_read\":");
+    output_decimal(output, stats->symbols_read);
+    output_string(output, ",\"symbols_printed\":");
+    output_decimal(output, stats->symbols_printed);
+    output_string(output, ",\"bytes_mapped\":");
+    output_decimal(output, stats->bytes_mapped);
+    output_string(output, ",\"pages_mapped\":");
+    output_decimal(output, stats->pages_mapped);
+    output_string(output, ",\"file_pages\":");
+    output_decimal(output, stats->file_pages);
+    output_string(output, ",\"minor_faults\":");
+    output_decimal(output, stats->minor_faults);
+    output_string(output, ",\"major_faults\":");
+    output_decimal(output, stats->major_faults);
+    output_string(output, ",\"output_bytes\":");
+    output_decimal(output, stats->output_bytes);
+    output_string(output, ",\"cache_hits\":");
+    output_decimal(output, stats->cache_hits);
+    output_string(output, ",\"cache_misses\":");
+    output_decimal(output, stats->cache_misses);
+}
+
+/**
+ * Prints the per-file and aggregate statistics of a run to stderr. The
+ * faults of the totals are those of the whole process since the run started,
+ * every thread included. --diff and --link-check do not collect per-file
+ * statistics: their files print zero counters and only the process-wide
+ * fields of the totals are filled.
+ *
+ * @param mode STATS_TEXT or STATS_JSON.
+ * @param files The names of the files, in argument order.
+ * @param stats The statistics of every file.
+ * @param count The number of files.
+ * @param output_syscalls The number of write calls issued for the symbol output.
+ * @param wall_ns The wall-clock duration of the run.
+ * @param before The process usage sampled when the run started.
+ */
+void print_stats(int mode, char **files, Stats *stats, size_t count, uint64_t output_syscalls, uint64_t wall_ns,
+                 struct rusage *before)
+{
+    Output output;
+    Stats total = {0};
+    struct rusage usage;
+
+    if (!output_init(&output, 2))
+        return;
+    for (size_t n = 0; n < count; n++)
+        stats_merge(&total, &stats[n]);
+    if (getrusage(RUSAGE_SELF, &usage))
+        usage = *before;
+    total.minor_faults = usage.ru_minflt - before->ru_minflt;
+    total.major_faults = usage.ru_majflt - before->ru_majflt;
+
+    if (mode == STATS_JSON)
+    {
+        output_string(&output, "{\"files\":[");
+        for (size_t n = 0; n < count; n++)
+        {
+            output_string(&output, n ? ",{\"name\":" : "{\"name\":");
+            output_json_string(&output, files[n]);
+            output_char(&output, ',');
+            print_stats_json(&output, &stats[n]);
+            output_char(&output, '}');
+        }
+        output_string(&output, "],\"total\":{\"files\":");
+        output_decimal(&output, count);
+        output_char(&output, ',');
+        print_stats_json(&output, &total);
+        output_string(&output, ",\"output_syscalls\":");
+        output_decimal(&output, output_syscalls);
+        output_string(&output, ",\"peak_rss_kb\":");
+        output_decimal(&output, usage.ru_maxrss);
+        output_string(&output, ",\"wall_ns\":");
+        output_decimal(&output, wall_ns);
+        output_string(&output, "}}\n");
+    }
+    else
+    {
+        for (size_t n = 0; n < count; n++)
+        {
+            print_stats_text(&output, files[n], &stats[n]);
+            output_char(&output, '\n');
+        }
+        print_stats_text(&output, "total", &total);
+        output_string(&output, "; ");
+        output_decimal(&output, output_syscalls);
+        output_string(&output, " output syscalls; peak RSS ");
+        output_decimal(&output, usage.ru_maxrss);
+        output_string(&output, " KB; wall ");
+        output_milliseconds(&output, wall_ns);
+        output_string(&output, " ms\n");
+    }
+    output_release(&output);
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <errno.h>
+
+#include "nm.h"
+#include "elf_readers.h"
+
+#define STREAM_CHUNK (1 << 16)   // Bytes read from the stream at a time
+#define STREAM_RESERVE (1 << 24) // First address range reserved, grown by doubling without copying
+
+// A non-seekable input read into a reservation as large as everything read so far
+typedef struct Stream
+{
+    File *file;              // elf_header pointing at the reservation
+    size_t reserved;
+    uint64_t position;       // Bytes read so far
+    bool identified;         // The magic number has been read
+    const ElfReader *reader; // Reader of an ELF stream, NULL for anything else
+    MapRange *ranges;        // Page ranges kept once the section headers are read, NULL keeps everything
+    size_t range_count;
+} Stream;
+
+/**
+ * Grows the reservation of a stream to hold a number of bytes. The pages are
+ * moved rather than copied, and the ones never written cost no memory.
+ *
+ * @param stream The stream.
+ * @param size The number of bytes the reservation has to hold.
+ * @return 1 if the reservation is large enough, 0 otherwise.
+ */
+int stream_reserve(Stream *stream, uint64_t size)
+{
+    size_t reserved = stream->reserved;
+    void *base;
+
+    while (reserved < size)
+        reserved *= 2;
+    if (reserved == stream->reserved)
+        return 1;
+    base = mremap(stream->file->elf_header, stream->reserved, reserved, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED)
+        return 0;
+    stream->file->elf_header = base;
+    stream->reserved = reserved;
+    return 1;
+}
+
+/**
+ * Copies the parts of a chunk read from a stream that fall in its kept
+ * ranges to their offset in the reservation, everything before the ranges are known.
+ *
+ * @param stream The stream, position at the offset of the chunk.
+ * @param chunk The bytes read.
+ * @param length The number of bytes read.
+ */
+void stream_keep(Stream *stream, char *chunk, size_t length)
+{
+    char *base = stream->file->elf_header;
+    uint64_t end = stream->position + length;
+    uint64_t from;
+    uint64_t to;
+
+    if (!stream->ranges)
+    {
+        memcpy(base + stream->position, chunk, length);
+        return;
+    }
+    for (size_t n = 0; n < stream->range_count && stream->ranges[n].start < end; n++)
+    {
+        from = stream->ranges[n].start > stream->position ? stream->ranges[n].start : stream->position;
+        to = stream->ranges[n].end < end ? stream->ranges[n].end : end;
+        if (from < to)
+            memcpy(base + from, chunk + (from - stream->position), to - from);
+    }
+}
+
+/**
+ * Selects the ranges of an ELF stream to keep once its section headers are
+ * read: the header, the section headers and the tables the reader uses. The
+ * pages already read outside of them are given back, and later bytes are
+ * only kept inside them.
+ *
+ * @param stream The stream, its reader set.
+ * @return 1 unless the ranges could not be allocated.
+ */
+int stream_select(Stream *stream)
+{
+    char *base = stream->file->elf_header;
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t read = (stream->position + page - 1) & ~(page - 1);
+    uint64_t limit = 0;
+    uint64_t released = 0;
+    MapRange table;
+    size_t count;
+
+    // Malformed headers keep the whole stream for check_file_data to report
+    if (stream->position < sizeof(Elf64_Ehdr))
+        return 1;
+    if (!stream->reader->section_table(stream->file, &table))
+    {
+        stream->reader = NULL;
+        return 1;
+    }
+    if (stream->position < table.end)
+        return 1;
+    count = (table.end - table.start) / sizeof(Elf32_Shdr) * 2 + 2;
+    if (!(stream->ranges = memory_allocate(stream->file->allocator, sizeof(MapRange) * count)))
+        return 0;
+    count = stream->reader->table_ranges(stream->file, stream->ranges);
+    stream->ranges[count++] = table;
+    stream->ranges[count++] = (MapRange){0, sizeof(Elf64_Ehdr), false};
+    for (size_t n = 0; n < count; n++)
+        if (stream->ranges[n].end > limit)
+            limit = stream->ranges[n].end;
+    stream->range_count = merge_map_ranges(stream->ranges, count, limit);
+
+    for (size_t n = 0; n <= stream->range_count && released < read; n++)
+    {
+        limit = n < stream->range_count && stream->ranges[n].start < read ? stream->ranges[n].start : read;
+        if (released < limit)
+            madvise(base + released, limit - released, MADV_DONTNEED);
+        if (n < stream->range_count)
+            released = stream->ranges[n].end;
+    }
+    return 1;
+}
+
+/**
+ * Reads a non-seekable input, such as a pipe, into memory at the offsets its
+ * bytes have in the file. An ELF stream is kept whole only until its section
+ * headers are read, then only its tables are: the memory left is about the
+ * size of the symbol and string tables. Anything else is kept whole.
+ *
+ * @param file The file receiving the reservation in elf_header and the length of the stream in file_size.
+ * @param fd The descriptor to read.
+ * @param kept Receives the number of bytes kept in memory.
+ * @return 1 if the whole stream is read, 0 otherwise.
+ */
+int read_stream(File *file, int fd, size_t *kept)
+{
+    Stream stream = {file, STREAM_RESERVE, 0, false, NULL, NULL, 0};
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    char *chunk;
+    ssize_t got;
+    int result = 1;
+
+    file->elf_header = mmap(NULL, STREAM_RESERVE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (file->elf_header == MAP_FAILED || !(chunk = memory_allocate(file->allocator, STREAM_CHUNK)))
+    {
+        if (file->elf_header != MAP_FAILED)
+            munmap(file->elf_header, STREAM_RESERVE);
+        file->elf_header = NULL;
+        return 0;
+    }
+
+    // Every range lies inside the file until its end is known
+    file->file_size = SIZE_MAX;
+    do
+    {
+        got = read(fd, chunk, STREAM_CHUNK);
+        if (got <= 0)
+            continue;
+        if (!(result = stream_reserve(&stream, stream.position + got)))
+            break;
+        stream_keep(&stream, chunk, got);
+        stream.position += got;
+        if (!stream.identified && stream.position >= EI_NIDENT)
+        {
+            stream.identified = true;
+            stream.reader = select_elf_reader(file->elf_header);
+        }
+        if (stream.reader && !stream.ranges)
+            result = stream_select(&stream);
+    } while (result && (got > 0 || (got < 0 && errno == EINTR)));
+    memory_release(file->allocator, chunk);
+
+    if (!result || got < 0 || !stream.position)
+    {
+        munmap(file->elf_header, stream.reserved);
+        memory_release(file->allocator, stream.ranges);
+        file->elf_header = NULL;
+        file->file_size = 0;
+        return 0;
+    }
+
+    // Give back the reservation past the end, munmap only knows the size of the file
+    file->file_size = stream.position;
+    if (((file->file_size + page - 1) & ~(page - 1)) < stream.reserved)
+        mremap(file->elf_header, stream.reserved, (file->file_size + page - 1) & ~(page - 1), 0);
+    *kept = 0;
+    for (size_t n = 0; n < stream.range_count && stream.ranges[n].start < file->file_size; n++)
+        *kept += (stream.ranges[n].end < file->file_size ? stream.ranges[n].end : file->file_size) -
+                 stream.ranges[n].start;
+    if (!stream.ranges)
+        *kept = file->file_size;
+    memory_release(file->allocator, stream.ranges);
+    return 1;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "nm.h"
+
+// Counts behind the one-line inventory of a file
+typedef struct Summary
+{
+    size_t members; // Archive members summarized
+    size_t symbols; // Symbols nm would list
+    size_t undefined;
+} Summary;
+
+/**
+ * Returns the name of the object type of an ELF image.
+ *
+ * @param file The mapped image.
+ * @return The name of its e_type.
+ */
+char *summary_object_type(File *file)
+{
+    switch (elf_object_type(file))
+    {
+    case ET_REL:
+        return "relocatable";
+    case ET_EXEC:
+        return "executable";
+    case ET_DYN:
+        return "shared object";
+    case ET_CORE:
+        return "core file";
+    default:
+        return "unknown type";
+    }
+}
+
+/**
+ * Counts the symbols an ELF image would list with the options in effect, and
+ * how many of them are undefined. Images without symbols count none.
+ *
+ * @param file The mapped image.
+ * @param name The name used in error messages.
+ * @param options The options selecting the symbols.
+ * @param summary The counts to add to.
+ * @return 1 if the image is counted, 0 otherwise.
+ */
+int summarize_elf(File *file, char *name, Options options, Summary *summary)
+{
+    if (!file->reader->check_file_data(file, name, options))
+        return (0);
+    if (file->symbol_table)
+    {
+        if (!(options.find.pattern ? file->reader->find_symbols : file->reader->get_symbols)(file, options))
+        {
+            free_file_tables(file);
+            return (0);
+        }
+        summary->symbols += file->symbols.count;
+        for (size_t n = 0; n < file->symbols.count; n++)
+            summary->undefined += file->symbols.sections[n] == SHN_UNDEF && ELF64_ST_TYPE(file->symbols.infos[n]) != STT_FILE;
+        free_symbol_table(&file->symbols);
+    }
+    free_file_tables(file);
+    return (1);
+}
+
+/**
+ * Prints the inventory line of a file: "name: format, N symbols, U undefined",
+ * the format being the class, byte order and type of an ELF image, or the
+ * member count of an archive.
+ *
+ * @param output The output the line is appended to.
+ * @param name The name of the file.
+ * @param file The mapped file, an ELF image unless archive is set.
+ * @param archive Whether the file is an archive.
+ * @param summary The counts of the file.
+ */
+void print_summary(Output *output, char *name, File *file, bool archive, Summary *summary)
+{
+    output_string(output, name);
+    if (archive)
+    {
+        output_write(output, ": archive, ", 11);
+        output_decimal(output, summary->members);
+        output_write(output, " members, ", 10);
+    }
+    else
+    {
+        output_write(output, file->file_type == ELF32 ? ": ELF 32-bit " : ": ELF 64-bit ", 13);
+        output_string(output, ((unsigned char *)file->elf_header)[EI_DATA] == ELFDATA2MSB ? "MSB " : "LSB ");
+        output_string(output, summary_object_type(file));
+        output_write(output, ", ", 2);
+    }
+    output_decimal(output, summary->symbols);
+    output_write(output, " symbols, ", 10);
+    output_decimal(output, summary->undefined);
+    output_write(output, " undefined\n", 11);
+}
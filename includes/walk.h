@@ -0,0 +1,408 @@
+#pragma once
+
+#include <ar.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "nm.h"
+
+#define WALK_BUFFER_SIZE (1 << 16)
+#define WALK_MAX_WORKERS 64
+
+// One result of a walk: a file worth reading, or a directory that could not be read
+typedef struct WalkEntry
+{
+    char *path;
+    int error; // errno of the directory that could not be read, 0 for files
+} WalkEntry;
+
+// Directories waiting to be read by one worker. The owner takes the newest
+// ones, thieves take the oldest, which tend to hold the largest subtrees.
+typedef struct WalkQueue
+{
+    pthread_mutex_t lock;
+    char **directories;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    WalkEntry *entries; // Found by the owner of the queue
+    size_t entry_count;
+    size_t entry_capacity;
+} WalkQueue;
+
+typedef struct Walk
+{
+    WalkQueue queues[WALK_MAX_WORKERS];
+    int workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work; // Signaled when a directory is queued or the last one is read
+    size_t pending;      // Directories queued or being read
+    size_t generation;   // Number of directories queued so far
+    bool failed;         // Memory ran out, part of the tree was skipped
+} Walk;
+
+typedef struct WalkWorker
+{
+    Walk *walk;
+    int id;
+} WalkWorker;
+
+/**
+ * Prints the error of a directory that could not be read during a walk.
+ *
+ * @param output The output the error is appended to.
+ * @param path The path of the directory.
+ * @param error The errno of the failure.
+ * @return 0, the directory counts as a failed file.
+ */
+int walk_error(Output *output, char *path, int error)
+{
+    file_errors(output, ": ", path, ": ");
+    output_string(output, strerror(error));
+    output_char(output, '\n');
+    return 0;
+}
+
+/**
+ * Joins a directory path and an entry name.
+ *
+ * @param directory The path of the directory.
+ * @param name The name of the entry.
+ * @return The malloc'd path, or NULL.
+ */
+char *walk_join(char *directory, char *name)
+{
+    size_t length = string_length(directory);
+    size_t name_length = string_length(name);
+    char *path;
+
+    if (length && directory[length - 1] == '/')
+        length--;
+    if (!(path = malloc(length + name_length + 2)))
+        return NULL;
+    memcpy(path, directory, length);
+    path[length] = '/';
+    memcpy(path + length + 1, name, name_length + 1);
+    return path;
+}
+
+/**
+ * Records a result of the walk in a worker's queue. Only the owner of the
+ * queue touches its entries, so no lock is taken.
+ *
+ * @param queue The queue of the worker.
+ * @param path The malloc'd path, owned by the queue from now on.
+ * @param error The errno of a directory that could not be read, or 0.
+ * @return 1 if the entry is recorded, 0 if memory ran out.
+ */
+int walk_add_entry(WalkQueue *queue, char *path, int error)
+{
+    WalkEntry *grown;
+    size_t capacity;
+
+    if (queue->entry_count == queue->entry_capacity)
+    {
+        capacity = queue->entry_capacity ? queue->entry_capacity * 2 : 64;
+        if (!(grown = realloc(queue->entries, sizeof(WalkEntry) * capacity)))
+        {
+            free(path);
+            return 0;
+        }
+        queue->entries = grown;
+        queue->entry_capacity = capacity;
+    }
+    queue->entries[queue->entry_count++] = (WalkEntry){path, error};
+    return 1;
+}
+
+/**
+ * Queues a directory on a worker's queue and wakes an idle worker to steal it.
+ *
+ * @param walk The walk.
+ * @param queue The queue of the worker that found the directory.
+ * @param path The malloc'd path, owned by the queue from now on.
+ * @return 1 if the directory is queued, 0 if memory ran out.
+ */
+int walk_push_directory(Walk *walk, WalkQueue *queue, char *path)
+{
+    char **grown;
+    size_t capacity;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail == queue->capacity && queue->head)
+    {
+        // Reclaim the room left by stolen directories before growing
+        memmove(queue->directories, queue->directories + queue->head, sizeof(char *) * (queue->tail - queue->head));
+        queue->tail -= queue->head;
+        queue->head = 0;
+    }
+    if (queue->tail == queue->capacity)
+    {
+        capacity = queue->capacity ? queue->capacity * 2 : 64;
+        if (!(grown = realloc(queue->directories, sizeof(char *) * capacity)))
+        {
+            pthread_mutex_unlock(&queue->lock);
+            free(path);
+            return 0;
+        }
+        queue->directories = grown;
+        queue->capacity = capacity;
+    }
+    queue->directories[queue->tail++] = path;
+    pthread_mutex_unlock(&queue->lock);
+
+    pthread_mutex_lock(&walk->lock);
+    walk->pending++;
+    walk->generation++;
+    pthread_cond_signal(&walk->work);
+    pthread_mutex_unlock(&walk->lock);
+    return 1;
+}
+
+/**
+ * Takes the next directory for a worker: the newest one of its own queue,
+ * or else the oldest one of another worker's queue.
+ *
+ * @param walk The walk.
+ * @param id The worker.
+ * @return The malloc'd path of the directory, or NULL if every queue is empty.
+ */
+char *walk_take_directory(Walk *walk, int id)
+{
+    WalkQueue *queue;
+    char *path = NULL;
+
+    for (int n = 0; n < walk->workers && !path; n++)
+    {
+        queue = &walk->queues[(id + n) % walk->workers];
+        pthread_mutex_lock(&queue->lock);
+        if (queue->head < queue->tail)
+            path = n ? queue->directories[queue->head++] : queue->directories[--queue->tail];
+        if (queue->head == queue->tail)
+        {
+            queue->head = 0;
+            queue->tail = 0;
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return path;
+}
+
+/**
+ * Checks whether a regular file is worth reading, an ELF file or an archive,
+ * from its first bytes alone, without mapping it.
+ *
+ * @param directory The descriptor of the directory holding the file.
+ * @param name The name of the file.
+ * @return true if the file starts with an ELF or archive magic number, false otherwise.
+ */
+bool walk_candidate(int directory, char *name)
+{
+    char magic[SARMAG];
+    ssize_t length;
+    int fd;
+
+    if ((fd = openat(directory, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK)) < 0)
+        return false;
+    length = pread(fd, magic, SARMAG, 0);
+    close(fd);
+    return (length >= SELFMAG && !memcmp(magic, ELFMAG, SELFMAG)) ||
+           (length == SARMAG && !memcmp(magic, ARMAG, SARMAG));
+}
+
+/**
+ * Reads a directory with getdents64: subdirectories are queued, ELF files and
+ * archives are recorded, anything else is skipped. Symbolic links are not
+ * followed, as find does not follow them.
+ *
+ * @param walk The walk.
+ * @param id The worker reading the directory.
+ * @param path The path of the directory, owned by the walk from now on.
+ * @param buffer A buffer of WALK_BUFFER_SIZE bytes.
+ * @return 1 if the directory is read, 0 if memory ran out.
+ */
+int walk_directory(Walk *walk, int id, char *path, char *buffer)
+{
+    WalkQueue *queue = &walk->queues[id];
+    struct dirent64 *entry;
+    struct stat entry_stats;
+    unsigned char type;
+    ssize_t length;
+    char *child;
+    int fd;
+    int error;
+    int ok = 1;
+
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return walk_add_entry(queue, path, errno);
+    while (ok && (length = getdents64(fd, buffer, WALK_BUFFER_SIZE)) > 0)
+    {
+        for (ssize_t offset = 0; ok && offset < length; offset += entry->d_reclen)
+        {
+            entry = (struct dirent64 *)(buffer + offset);
+            if (entry->d_name[0] == '.' && (!entry->d_name[1] || (entry->d_name[1] == '.' && !entry->d_name[2])))
+                continue;
+
+            // Some file systems leave the type to be found with a stat
+            type = entry->d_type;
+            if (type == DT_UNKNOWN && !fstatat(fd, entry->d_name, &entry_stats, AT_SYMLINK_NOFOLLOW))
+                type = S_ISDIR(entry_stats.st_mode) ? DT_DIR : S_ISREG(entry_stats.st_mode) ? DT_REG : DT_UNKNOWN;
+            if (type != DT_DIR && (type != DT_REG || !walk_candidate(fd, entry->d_name)))
+                continue;
+            if (!(child = walk_join(path, entry->d_name)))
+                ok = 0;
+            else if (type == DT_DIR)
+                ok = walk_push_directory(walk, queue, child);
+            else
+                ok = walk_add_entry(queue, child, 0);
+        }
+    }
+    error = ok && length < 0 ? errno : 0;
+    close(fd);
+    if (error)
+        return walk_add_entry(queue, path, error);
+    free(path);
+    return ok;
+}
+
+/**
+ * Worker loop: reads directories from its own queue, steals from the others
+ * when it runs dry, and sleeps until a directory is queued. The walk ends
+ * when no directory is queued nor being read.
+ *
+ * @param argument The WalkWorker.
+ * @return NULL.
+ */
+void *walk_worker(void *argument)
+{
+    WalkWorker *worker = argument;
+    Walk *walk = worker->walk;
+    char *buffer = malloc(WALK_BUFFER_SIZE);
+    size_t generation;
+    char *path;
+    int ok;
+
+    while (true)
+    {
+        // Directories queued after the generation is read wake the worker up
+        pthread_mutex_lock(&walk->lock);
+        generation = walk->generation;
+        pthread_mutex_unlock(&walk->lock);
+        if ((path = walk_take_directory(walk, worker->id)))
+        {
+            // Without a buffer the worker still drains the queues so the walk ends
+            ok = buffer && walk_directory(walk, worker->id, path, buffer);
+            if (!buffer)
+                free(path);
+            pthread_mutex_lock(&walk->lock);
+            walk->failed = walk->failed || !ok;
+            if (!--walk->pending)
+                pthread_cond_broadcast(&walk->work);
+            pthread_mutex_unlock(&walk->lock);
+            continue;
+        }
+        pthread_mutex_lock(&walk->lock);
+        while (walk->pending && walk->generation == generation)
+            pthread_cond_wait(&walk->work, &walk->lock);
+        if (!walk->pending)
+        {
+            pthread_mutex_unlock(&walk->lock);
+            break;
+        }
+        pthread_mutex_unlock(&walk->lock);
+    }
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Orders walk entries by path.
+ *
+ * @param a The first WalkEntry.
+ * @param b The second WalkEntry.
+ * @return The strcmp order of the paths.
+ */
+int compare_walk_entries(const void *a, const void *b)
+{
+    return strcmp(((const WalkEntry *)a)->path, ((const WalkEntry *)b)->path);
+}
+
+/**
+ * Walks a directory tree on a pool of work-stealing threads and returns the
+ * ELF files and archives found in it, with the directories that could not
+ * be read, in path order whatever the scheduling. A root that is not a
+ * directory is returned as is, for the usual error paths to report.
+ *
+ * @param root The root of the tree.
+ * @param workers The number of threads.
+ * @param entries Receives the malloc'd entries.
+ * @param count Receives the number of entries.
+ * @return 1 if the whole tree was walked, 0 if memory ran out.
+ */
+int walk_tree(char *root, int workers, WalkEntry **entries, size_t *count)
+{
+    Walk *walk;
+    WalkWorker runs[WALK_MAX_WORKERS];
+    pthread_t threads[WALK_MAX_WORKERS];
+    bool started[WALK_MAX_WORKERS];
+    struct stat root_stats;
+    size_t total = 0;
+    char *path;
+    int result;
+
+    *entries = NULL;
+    *count = 0;
+    if (stat(root, &root_stats) || !S_ISDIR(root_stats.st_mode))
+    {
+        if (!(*entries = malloc(sizeof(WalkEntry))) || !((*entries)->path = strdup(root)))
+            return 0;
+        (*entries)->error = 0;
+        *count = 1;
+        return 1;
+    }
+    if (!(walk = calloc(1, sizeof(Walk))))
+        return 0;
+    walk->workers = workers < 1 ? 1 : workers > WALK_MAX_WORKERS ? WALK_MAX_WORKERS : workers;
+    pthread_mutex_init(&walk->lock, NULL);
+    pthread_cond_init(&walk->work, NULL);
+    for (int n = 0; n < walk->workers; n++)
+    {
+        pthread_mutex_init(&walk->queues[n].lock, NULL);
+        runs[n] = (WalkWorker){walk, n};
+    }
+
+    // The root seeds the first queue, the other workers start by stealing from it
+    if (!(path = strdup(root)) || !walk_push_directory(walk, &walk->queues[0], path))
+        walk->failed = true;
+    for (int n = 1; n < walk->workers; n++)
+        started[n] = !pthread_create(&threads[n], NULL, walk_worker, &runs[n]);
+    walk_worker(&runs[0]);
+    for (int n = 1; n < walk->workers; n++)
+        if (started[n])
+            pthread_join(threads[n], NULL);
+
+    // Gather the entries of every worker and sort them by path
+    for (int n = 0; n < walk->workers; n++)
+        total += walk->queues[n].entry_count;
+    result = !walk->failed && (*entries = malloc(sizeof(WalkEntry) * (total + 1)));
+    for (int n = 0; n < walk->workers; n++)
+    {
+        for (size_t m = 0; m < walk->queues[n].entry_count; m++)
+        {
+            if (result)
+                (*entries)[(*count)++] = walk->queues[n].entries[m];
+            else
+                free(walk->queues[n].entries[m].path);
+        }
+        free(walk->queues[n].entries);
+        free(walk->queues[n].directories);
+        pthread_mutex_destroy(&walk->queues[n].lock);
+    }
+    if (result)
+        qsort(*entries, *count, sizeof(WalkEntry), compare_walk_entries);
+    pthread_cond_destroy(&walk->work);
+    pthread_mutex_destroy(&walk->lock);
+    free(walk);
+    return result;
+}
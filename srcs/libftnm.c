@@ -0,0 +1,300 @@
+#include "includes/nm.h"
+#include "includes/libftnm.h"
+#include "includes/elf_readers.h"
+#include "includes/sort.h"
+#include "includes/archive.h"
+#include "includes/file_data.h"
+
+#define FTNM_API __attribute__((visibility("default")))
+
+// Everything a handle allocates goes through its allocator, passed down in its File and Output structures
+struct Ftnm
+{
+    Allocator allocator;
+    const Allocator *memory; // &allocator, or NULL for the C library's
+    Options options;
+    char *name;      // Name of the file in error messages
+    File file;       // The whole file
+    bool mapped;     // file.elf_header was mapped by the handle rather than given
+    Archive archive; // Members of an archive, none for an ELF file
+    size_t member;   // Next archive member to load
+    File image;      // The ELF image whose symbols are yielded, the file or a member
+    bool loaded;     // image holds symbols
+    size_t next;     // Next symbol of image
+    bool done;       // Every image was loaded
+    bool failed;     // The file could not be read, reported by the first ftnm_next
+    Output errors;   // Message of the last error
+};
+
+/**
+ * Allocates a handle with the given allocator and sets up its options from the flags.
+ *
+ * @param name The name of the file in error messages.
+ * @param flags FTNM_* flags.
+ * @param allocator The memory functions, or NULL for the C library's.
+ * @return The handle, or NULL if it could not be allocated.
+ */
+Ftnm *ftnm_create(const char *name, unsigned flags, const FtnmAllocator *allocator)
+{
+    Allocator memory = {0};
+    size_t length = string_length((char *)name);
+    Ftnm *handle;
+
+    if (allocator)
+        memory = (Allocator){allocator->allocate, allocator->reallocate, allocator->release, allocator->context};
+    if (!(handle = memory_allocate_zeroed(allocator ? &memory : NULL, 1, sizeof(Ftnm))))
+        return NULL;
+    handle->allocator = memory;
+    handle->memory = allocator ? &handle->allocator : NULL;
+    if (!(handle->name = memory_allocate(handle->memory, length + 1)) ||
+        !output_init_allocator(&handle->errors, -1, handle->memory))
+    {
+        memory_release(handle->memory, handle->name);
+        memory_release(allocator ? &memory : NULL, handle);
+        return NULL;
+    }
+    memcpy(handle->name, name, length + 1);
+
+    // Symbols are decoded with their sizes, on the calling thread only; objects
+    // without symbols are left without a symbol table and yield none
+    handle->options.dynamic = !!(flags & FTNM_DYNAMIC);
+    handle->options.all = !!(flags & FTNM_ALL);
+    handle->options.undefined = !!(flags & FTNM_UNDEFINED);
+    handle->options.globals = !!(flags & FTNM_GLOBALS);
+    handle->options.not_sorted = !(flags & FTNM_SORTED);
+    handle->options.reverse = !!(flags & FTNM_REVERSE);
+    handle->options.diff_values = 1;
+    handle->options.jobs = 1;
+    handle->file.output = &handle->errors;
+    handle->file.allocator = handle->memory;
+    return handle;
+}
+
+/**
+ * Reads the member table of an archive handle.
+ *
+ * @param handle The handle, its file set.
+ */
+void ftnm_read_file(Ftnm *handle)
+{
+    if (handle->file.file_type != ARCHIVE)
+        return;
+    handle->failed = !read_archive(&handle->archive, &handle->file, handle->name);
+}
+
+/**
+ * Opens a file for reading its symbols, documented in libftnm.h.
+ *
+ * @param path The path of the file, "-" for the standard input.
+ * @param flags FTNM_* flags.
+ * @param allocator The memory functions, or NULL for the C library's.
+ * @return The handle, or NULL if it could not be allocated.
+ */
+FTNM_API Ftnm *ftnm_open(const char *path, unsigned flags, const FtnmAllocator *allocator)
+{
+    Ftnm *handle;
+
+    if ((handle = ftnm_create(path, flags, allocator)))
+    {
+        handle->mapped = true;
+        if (!get_file_data(&handle->file, handle->name, NULL))
+        {
+            if (handle->file.elf_header)
+                munmap(handle->file.elf_header, handle->file.file_size);
+            handle->file.elf_header = NULL;
+            handle->failed = true;
+        }
+        else
+            ftnm_read_file(handle);
+    }
+    return handle;
+}
+
+/**
+ * Opens an image in memory, documented in libftnm.h.
+ *
+ * @param data The image.
+ * @param size The size of the image.
+ * @param name The name used in error messages.
+ * @param flags FTNM_* flags.
+ * @param allocator The memory functions, or NULL for the C library's.
+ * @return The handle, or NULL if it could not be allocated.
+ */
+FTNM_API Ftnm *ftnm_open_memory(const void *data, size_t size, const char *name, unsigned flags,
+                                const FtnmAllocator *allocator)
+{
+    Ftnm *handle;
+
+    if ((handle = ftnm_create(name, flags, allocator)))
+    {
+        handle->file.elf_header = (void *)data;
+        handle->file.file_size = size;
+        if (size >= SARMAG && is_archive(&handle->file))
+            handle->file.file_type = ARCHIVE;
+        else
+            handle->failed = !get_elf_type(&handle->file, handle->name);
+        if (!handle->failed)
+            ftnm_read_file(handle);
+    }
+    return handle;
+}
+
+/**
+ * Releases the symbols and tables of the image being yielded.
+ *
+ * @param handle The handle.
+ */
+void ftnm_unload(Ftnm *handle)
+{
+    if (!handle->loaded)
+        return;
+    free_symbol_table(&handle->image.symbols);
+    free_file_tables(&handle->image);
+    handle->loaded = false;
+}
+
+/**
+ * Loads the symbols of the next image: the file itself, or the next member
+ * of an archive, sorted when the handle asks for it.
+ *
+ * @param handle The handle, no image loaded.
+ * @return 1 if an image is loaded, 0 if none is left, -1 if the image could not be read.
+ */
+int ftnm_load(Ftnm *handle)
+{
+    ArchiveMember *member;
+    char *name = handle->name;
+
+    if (handle->done)
+        return 0;
+    if (handle->file.file_type == ARCHIVE)
+    {
+        if (handle->member >= handle->archive.member_count)
+        {
+            handle->done = true;
+            return 0;
+        }
+        member = &handle->archive.members[handle->member++];
+        handle->image = (File){0};
+        handle->image.elf_header = member->data;
+        handle->image.file_size = member->size;
+        handle->image.output = &handle->errors;
+        handle->image.allocator = handle->memory;
+        name = member->name;
+        if (!get_elf_type(&handle->image, name))
+            return -1;
+    }
+    else
+    {
+        handle->image = handle->file;
+        handle->done = true;
+    }
+
+    // Every message of the image is its error, a successful load leaves none
+    if (!handle->image.reader->check_file_data(&handle->image, name, handle->options))
+    {
+        free_file_tables(&handle->image);
+        return -1;
+    }
+    if (handle->image.symbol_table && !handle->image.reader->get_symbols(&handle->image, handle->options))
+    {
+        free_file_tables(&handle->image);
+        return -1;
+    }
+    if (!handle->options.not_sorted)
+        sort_symbols(&handle->image, handle->options);
+    handle->loaded = true;
+    handle->next = 0;
+    return 1;
+}
+
+/**
+ * Yields the next symbol, loading the next image once the current one is
+ * exhausted, documented in libftnm.h.
+ *
+ * @param handle The handle.
+ * @param symbol Receives the symbol.
+ * @return 1 if a symbol is yielded, 0 once every symbol was, -1 on an error.
+ */
+FTNM_API int ftnm_next(Ftnm *handle, FtnmSymbol *symbol)
+{
+    SymbolTable *symbols = &handle->image.symbols;
+    Symbol decoded;
+    size_t index;
+    uint16_t version;
+    int result = 1;
+
+    if (handle->failed)
+    {
+        handle->failed = false;
+        handle->done = true;
+        result = -1;
+    }
+    while (result == 1 && (!handle->loaded || handle->next >= symbols->count))
+    {
+        ftnm_unload(handle);
+        handle->errors.length = 0;
+        result = ftnm_load(handle);
+    }
+    if (result == 1)
+    {
+        index = symbols->order[handle->next++];
+        decoded = get_symbol(&handle->image, index);
+        version = decoded.version & 0x7fff;
+        symbol->name = decoded.name;
+        symbol->member = handle->file.file_type == ARCHIVE ? handle->archive.members[handle->member - 1].name : NULL;
+        symbol->version = handle->image.versions && version >= 1 && version < handle->image.version_count &&
+                                  !(version == 1 && handle->image.versions[version].base)
+                              ? handle->image.versions[version].name
+                              : NULL;
+        symbol->value = decoded.value;
+        symbol->size = symbols->sizes[index];
+        symbol->type = decoded.letter;
+        symbol->hidden = decoded.version & 0x8000;
+    }
+    return result;
+}
+
+/**
+ * Returns the message of the last error, documented in libftnm.h.
+ *
+ * @param handle The handle.
+ * @return The message, an empty string if no error happened.
+ */
+FTNM_API const char *ftnm_error(Ftnm *handle)
+{
+    // The message is kept without its newline
+    if (handle->errors.length && handle->errors.buffer[handle->errors.length - 1] == '\n')
+        handle->errors.length--;
+    if (!output_reserve(&handle->errors, 1))
+        handle->errors.length = 0;
+    if (!handle->errors.buffer)
+        return "";
+    handle->errors.buffer[handle->errors.length] = '\0';
+    return handle->errors.buffer;
+}
+
+/**
+ * Releases a handle, documented in libftnm.h.
+ *
+ * @param handle The handle, or NULL.
+ */
+FTNM_API void ftnm_close(Ftnm *handle)
+{
+    Allocator allocator;
+    const Allocator *memory;
+
+    if (!handle)
+        return;
+    ftnm_unload(handle);
+    free_archive(&handle->archive);
+    if (handle->mapped && handle->file.elf_header)
+        munmap(handle->file.elf_header, handle->file.file_size);
+    output_release(&handle->errors);
+    memory_release(handle->memory, handle->name);
+
+    // The handle holds the allocator releasing it
+    allocator = handle->allocator;
+    memory = handle->memory ? &allocator : NULL;
+    memory_release(memory, handle);
+}
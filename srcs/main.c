@@ -1,88 +1,379 @@
 #include "includes/nm.h"
-#include "includes/nm64.h"
-#include "includes/nm32.h"
+#include "includes/elf_readers.h"
+#include "includes/sort.h"
+#include "includes/archive.h"
+#include "includes/cache.h"
+#include "includes/lookup.h"
+#include "includes/link.h"
+#include "includes/diff.h"
+#include "includes/walk.h"
+#include "includes/summary.h"
+#include "includes/prefetch.h"
+#include "includes/file_list.h"
+#include "includes/stream.h"
+#include "includes/file_data.h"
+#include "includes/serve.h"
+
+// Itanium C++ ABI demangler of the C++ runtime, the one GNU nm's output matches
+char *__cxa_demangle(const char *mangled, char *buffer, size_t *length, int *status);
 
 /**
  * Parses the command line flags and updates the options accordingly.
+ * Every argument that is not a flag, nor the value of one, is collected as a file name.
  *
  * @param option The options structure to update.
  * @param argc The number of command line arguments.
  * @param argv The array of command line arguments.
+ * @param files The array receiving the file names, large enough for argc entries.
+ * @return The number of file names collected.
  */
-void parse_flags(Options *option, int argc, char **argv)
+int parse_flags(Options *option, int argc, char **argv, char **files)
 {
+    int file_count = 0;
+
     for (int i = 1; i < argc; i++)
     {
-        if (argv[i][0] == '-')
+        if (argv[i][0] == '@' && argv[i][1])
+        {
+            option->file_lists[option->file_list_count++] = argv[i] + 1;
+            continue;
+        }
+        if (argv[i][0] != '-' || !argv[i][1])
+        {
+            files[file_count++] = argv[i];
+            continue;
+        }
+        if (argv[i][1] == '-')
+        {
+            // Long options
+            if (!string_compare(argv[i], "--stats"))
+                option->stats = STATS_TEXT;
+            else if (!string_compare(argv[i], "--stats=json"))
+                option->stats = STATS_JSON;
+            else if (!string_compare(argv[i], "--cache") && i + 1 < argc)
+                option->cache_directory = argv[++i];
+            else if (!strncmp(argv[i], "--cache=", 8) && argv[i][8])
+                option->cache_directory = argv[i] + 8;
+            else if (!string_compare(argv[i], "--lookup") || !string_compare(argv[i], "--lookup=-"))
+                option->lookup = 1;
+            else if (!strncmp(argv[i], "--lookup=", 9))
+            {
+                option->lookup = 1;
+                parse_lookup_addresses(option, argv[i] + 9, string_length(argv[i] + 9));
+            }
+            else if (!string_compare(argv[i], "--find") && i + 1 < argc)
+                parse_find_pattern(&option->find, argv[++i]);
+            else if (!strncmp(argv[i], "--find=", 7))
+                parse_find_pattern(&option->find, argv[i] + 7);
+            else if (!string_compare(argv[i], "--diff"))
+                option->diff = 1;
+            else if (!string_compare(argv[i], "--diff-values"))
+            {
+                option->diff = 1;
+                option->diff_values = 1;
+            }
+            else if (!string_compare(argv[i], "--link-check"))
+                option->link_check = 1;
+            else if (!string_compare(argv[i], "--collate"))
+                option->collate = 1;
+            else if (!string_compare(argv[i], "--summary"))
+                option->summary = 1;
+            else if (!string_compare(argv[i], "--files-from") && i + 1 < argc)
+                option->file_lists[option->file_list_count++] = argv[++i];
+            else if (!strncmp(argv[i], "--files-from=", 13) && argv[i][13])
+                option->file_lists[option->file_list_count++] = argv[i] + 13;
+            else if (!string_compare(argv[i], "--serve") && i + 1 < argc)
+                option->serve_socket = argv[++i];
+            else if (!strncmp(argv[i], "--serve=", 8) && argv[i][8])
+                option->serve_socket = argv[i] + 8;
+            else if (!strncmp(argv[i], "--serve-memory=", 15))
+            {
+                if (!(option->serve_budget = cache_parse_size(argv[i] + 15)))
+                    write(2, "ft_nm: invalid serve memory", 27);
+            }
+            else if (!strncmp(argv[i], "--cache-size=", 13))
+            {
+                if (!(option->cache_limit = cache_parse_size(argv[i] + 13)))
+                    write(2, "ft_nm: invalid cache size", 25);
+            }
+            else
+                write(2, "ft_nm: invalid option", 21);
+            continue;
+        }
+        for (int j = 1; argv[i][j] != '\0'; j++)
         {
-            for (int j = 1; argv[i][j] != '\0'; j++)
+            char flag = argv[i][j];
+            switch (flag)
             {
-                char flag = argv[i][j];
-                switch (flag)
+            case 'a':
+                option->all = 1;
+                break;
+            case 'C':
+                if (!option->demangle)
+                    option->demangle = demangle_cache_init(__cxa_demangle);
+                break;
+            case 'D':
+                option->dynamic = 1;
+                break;
+            case 'g':
+                option->globals = 1;
+                break;
+            case 'j':
+                // The job count is either glued to the flag or the next argument
+                if (argv[i][j + 1] != '\0')
+                    option->jobs = atoi(&argv[i][j + 1]);
+                else
+                    option->jobs = (i + 1 < argc) ? atoi(argv[++i]) : 0;
+                if (option->jobs <= 0)
                 {
-                case 'a':
-                    option->all = 1;
-                    break;
-                case 'g':
-                    option->globals = 1;
-                    break;
-                case 'p':
-                    option->not_sorted = 1;
-                    break;
-                case 'r':
-                    option->reverse = 1;
-                    break;
-                case 'u':
-                    option->undefined = 1;
-                    break;
-                default:
-                    write(2, "ft_nm: invalid option", 21);
-                    break;
+                    write(2, "ft_nm: invalid job count", 24);
+                    option->jobs = 0;
                 }
+                j = string_length(argv[i]) - 1;
+                break;
+            case 'p':
+                option->not_sorted = 1;
+                break;
+            case 'R':
+                // The directory is either glued to the flag or the next argument
+                if (argv[i][j + 1] != '\0')
+                    option->directories[option->directory_count++] = &argv[i][j + 1];
+                else if (i + 1 < argc)
+                    option->directories[option->directory_count++] = argv[++i];
+                else
+                    write(2, "ft_nm: -R needs a directory", 27);
+                j = string_length(argv[i]) - 1;
+                break;
+            case 'r':
+                option->reverse = 1;
+                break;
+            case 's':
+                option->archive_index = 1;
+                break;
+            case 'u':
+                option->undefined = 1;
+                break;
+            default:
+                write(2, "ft_nm: invalid option", 21);
+                break;
             }
         }
     }
+    return file_count;
 }
 
 /**
- * Retrieves file data for a given file.
+ * Prints the "\nname:\n" line introducing the symbols of a file or member.
  *
- * @param file The File structure to store the file data.
- * @param name The name of the file.
- * @return 1 if the file data retrieval is successful, 0 otherwise.
+ * @param output The output the header is appended to.
+ * @param header The name to print, or NULL to print nothing.
+ */
+void print_header(Output *output, char *header)
+{
+    if (header)
+    {
+        output_char(output, '\n');
+        output_string(output, header);
+        output_write(output, ":\n", 2);
+    }
+}
+
+/**
+ * Processes a mapped ELF image: checks its data, gets, sorts and prints its symbols.
+ * Unsorted output is streamed straight from the mapped symbol table instead,
+ * and in lookup mode the symbols only serve to resolve the lookup addresses.
+ *
+ * @param file The File structure holding the mapped image.
+ * @param name The name used in error messages.
+ * @param options The options to apply during processing.
+ * @param header The name printed before the symbols, or NULL to print none.
+ * @return 1 if the image is processed successfully, 0 otherwise.
  */
-int get_file_data(File *file, char *name)
+int process_elf(File *file, char *name, Options options, char *header)
 {
-    struct stat file_stats;
-    MagicNumber *magic;
+    struct rusage usage;
+    uint64_t start;
 
-    // Open the file
-    if ((file->file_descriptor = open(name, O_RDONLY)) <= 0)
-        return file_errors(": '", name, ":' No such file\n");
+    if (file->stats)
+        getrusage(RUSAGE_THREAD, &usage);
 
-    // Get file stats
-    if (fstat(file->file_descriptor, &file_stats))
-        return file_errors(": '", name, ":' No such file\n");
+    // Check file data based on file type
+    start = stats_start(file->stats);
+    if (!file->reader->check_file_data(file, name, options))
+        return (0);
+    stats_stop(file->stats, PHASE_CHECK, start);
 
-    // Check if the file is a regular file
-    if (!S_ISREG(file_stats.st_mode))
-        return file_errors(": Warning: '", name, "' is not an ordinary file\n");
+    // As in GNU nm, the header introduces the message of a member without symbols
+    if (!file->symbol_table)
+    {
+        print_header(file->output, header);
+        return file_errors(file->output, ": ", name, ": no symbols\n");
+    }
+    if (file->stats)
+        file->stats->symbols_read += file->symbol_count;
 
-    // Set file size and mmap the file
-    file->file_size = file_stats.st_size;
-    if (!(file->elf_header = mmap(0, file->file_size, PROT_READ, MAP_PRIVATE, file->file_descriptor, 0)))
-        return 0;
+    if (options.lookup)
+    {
+        // Resolve addresses against the defined symbols instead of listing them
+        start = stats_start(file->stats);
+        if (!file->reader->get_symbols(file, options))
+        {
+            free_file_tables(file);
+            return (0);
+        }
+        stats_stop(file->stats, PHASE_EXTRACT, start);
+        print_header(file->output, header);
+        print_lookups(file, options);
+        free_symbol_table(&file->symbols);
+    }
+    else if (options.not_sorted && !options.find.pattern)
+    {
+        // Nothing is reordered, so no symbol needs to be stored
+        print_header(file->output, header);
+        start = stats_start(file->stats);
+        file->reader->stream_symbols(file, options);
+        stats_stop(file->stats, PHASE_PRINT, start);
+    }
+    else
+    {
+        // Retrieve symbols based on file type, only the matching ones when searching
+        start = stats_start(file->stats);
+        if (!(options.find.pattern ? file->reader->find_symbols : file->reader->get_symbols)(file, options))
+        {
+            free_file_tables(file);
+            return (0);
+        }
+        if (options.demangle && !demangle_symbols(file, options.demangle, options.jobs))
+        {
+            free_symbol_table(&file->symbols);
+            free_file_tables(file);
+            return (0);
+        }
+        stats_stop(file->stats, PHASE_EXTRACT, start);
+        print_header(file->output, header);
 
-    // Close the file descriptor
-    close(file->file_descriptor);
+        // Sort and print symbols, matches are already in symbol table order
+        start = stats_start(file->stats);
+        if (!options.not_sorted)
+            sort_symbols(file, options);
+        stats_stop(file->stats, PHASE_SORT, start);
+        start = stats_start(file->stats);
+        print_symbols(file, options.jobs);
+        stats_stop(file->stats, PHASE_PRINT, start);
+        free_symbol_table(&file->symbols);
+    }
 
-    // Check the magic number to determine the file type
-    magic = (MagicNumber *)file->elf_header;
-    if (magic->magic_number != MAGIC_NUMBER)
-        return file_errors(": ", name, ": File format not recognized\n");
-    file->file_type = (magic->support == ELF32) ? ELF32 : ELF64;
+    // Free memory
+    free_file_tables(file);
+    stats_faults(file->stats, &usage);
 
-    return 1;
+    return (1);
+}
+
+/**
+ * Job routine processing one member of an archive straight from the archive mapping.
+ *
+ * @param context The Archive the member belongs to.
+ * @param index The index of the member to process.
+ * @param output The output the member's symbols and errors are appended to.
+ * @return 1 if the member is processed successfully, 0 otherwise.
+ */
+int process_member_job(void *context, size_t index, Output *output)
+{
+    Archive *archive = context;
+    ArchiveMember *member = &archive->members[index];
+    File file = {0};
+
+    file.elf_header = member->data;
+    file.file_size = member->size;
+    file.output = output;
+    file.stats = archive->member_stats ? &archive->member_stats[index] : NULL;
+    if (!get_elf_type(&file, member->name))
+        return (0);
+    return process_elf(&file, member->name, archive->options, member->name);
+}
+
+/**
+ * Processes a mapped archive: optionally prints its symbol index, then the
+ * symbols of every member, with members processed in parallel.
+ *
+ * @param file The File structure holding the mapped archive.
+ * @param name The name of the archive.
+ * @param options The options to apply during processing.
+ * @param multiple_programs Indicates if there are multiple programs being processed.
+ * @return 1 if every member is processed successfully, 0 otherwise.
+ */
+int process_archive(File *file, char *name, Options options, bool multiple_programs)
+{
+    Archive archive = {0};
+    size_t failures;
+
+    if (!read_archive(&archive, file, name))
+        return (0);
+    archive.options = options;
+    archive.options.jobs = share_job_budget(options.jobs, archive.member_count);
+
+    // Print the archive name if there are multiple programs
+    print_header(file->output, multiple_programs ? name : NULL);
+
+    // Dump the index straight from the armap
+    if (options.archive_index)
+        print_archive_index(&archive, file->output);
+
+    // Members get their own statistics, summed into the archive's once they are done
+    if (file->stats && !(archive.member_stats = calloc(archive.member_count + 1, sizeof(Stats))))
+    {
+        free_archive(&archive);
+        return (0);
+    }
+
+    failures = run_ordered_jobs(process_member_job, &archive, archive.member_count, options.jobs, file->output);
+    for (size_t n = 0; archive.member_stats && n < archive.member_count; n++)
+        stats_merge(file->stats, &archive.member_stats[n]);
+    free(archive.member_stats);
+    free_archive(&archive);
+    return (!failures);
+}
+
+/**
+ * Prints the inventory line of a mapped file. The members of an archive are
+ * counted one after the other, files are already summarized in parallel.
+ *
+ * @param file The File structure holding the mapped file.
+ * @param name The name of the file.
+ * @param options The options selecting the symbols counted.
+ * @return 1 if the whole file is counted, 0 otherwise.
+ */
+int summarize_file(File *file, char *name, Options options)
+{
+    Summary summary = {0};
+    Archive archive = {0};
+    File member;
+    int result;
+
+    if (file->file_type != ARCHIVE)
+    {
+        if ((result = summarize_elf(file, name, options, &summary)))
+            print_summary(file->output, name, file, false, &summary);
+        return (result);
+    }
+    if (!read_archive(&archive, file, name))
+        return (0);
+    result = 1;
+    for (size_t n = 0; n < archive.member_count; n++)
+    {
+        member = (File){0};
+        member.elf_header = archive.members[n].data;
+        member.file_size = archive.members[n].size;
+        member.output = file->output;
+        if (!get_elf_type(&member, archive.members[n].name) ||
+            !summarize_elf(&member, archive.members[n].name, options, &summary))
+            result = 0;
+    }
+    summary.members = archive.member_count;
+    print_summary(file->output, name, file, true, &summary);
+    free_archive(&archive);
+    return (result);
 }
 
 /**
@@ -92,52 +383,400 @@ int get_file_data(File *file, char *name)
  * @param filename The name of the file to process.
  * @param options The options to apply during processing.
  * @param multiple_programs Indicates if there are multiple programs being processed.
+ * @param output The output buffer the symbols and errors are appended to.
+ * @param stats The statistics of the file, or NULL.
+ * @param opened The descriptor and stat of the file prefetched in a batch, or NULL.
  * @return 1 if the file is processed successfully, 0 otherwise.
  */
-int process_file(char *filename, Options options, bool multiple_programs)
+int process_file(char *filename, Options options, bool multiple_programs, Output *output, Stats *stats,
+                 OpenedFile *opened)
 {
     File file = {0};
+    int result;
+    uint64_t start;
+    uint64_t output_start;
 
     // Get file data
-    if (!get_file_data(&file, filename))
-        return (file_errors(": ", filename, ": No such file or directory\n"));
-
-    // Check file data and retrieve symbols based on file type
-    if (file.file_type)
+    file.output = output;
+    file.stats = stats;
+    output_start = output_total(output);
+    start = stats_start(stats);
+    if (!get_file_data(&file, filename, opened))
     {
-        if (!check_file_data_32(&file, filename))
-            return (0);
-        get_symbols_32(&file);
+        if (file.elf_header)
+            munmap(file.elf_header, file.file_size);
+        file_errors(output, ": ", filename, ": No such file or directory\n");
+        if (stats)
+            stats->output_bytes += output_total(output) - output_start;
+        return (0);
     }
+    stats_stop(stats, PHASE_MAP, start);
+
+    // Dispatch on the file type
+    if (options.summary)
+        result = summarize_file(&file, filename, options);
+    else if (file.file_type == ARCHIVE)
+        result = process_archive(&file, filename, options, multiple_programs);
     else
+        result = process_elf(&file, filename, options, multiple_programs ? filename : NULL);
+
+    // Cleanup
+    munmap(file.elf_header, file.file_size);
+    if (stats)
+        stats->output_bytes += output_total(output) - output_start;
+
+    // Flush the file's output once it is complete
+    output_flush(output);
+
+    return (result);
+}
+
+/**
+ * Processes a file through the cache directory: a file whose device, inode,
+ * size, modification time and options match a cache entry is served from it,
+ * any other file is processed into memory and, when it succeeds, stored.
+ *
+ * @param filename The name of the file to process.
+ * @param options The options to apply during processing.
+ * @param multiple_programs Indicates if there are multiple programs being processed.
+ * @param output The output buffer the symbols and errors are appended to.
+ * @param stats The statistics of the file, or NULL.
+ * @param opened The descriptor and stat of the file prefetched in a batch, or NULL to open it here.
+ * @return 1 if the file is processed successfully, 0 otherwise.
+ */
+int process_file_cached(char *filename, Options options, bool multiple_programs, Output *output, Stats *stats,
+                        OpenedFile *opened)
+{
+    OpenedFile local = {0};
+    CacheKey key;
+    Output file_output;
+    char *name = multiple_programs ? filename : NULL;
+    uint64_t output_start;
+    int result;
+
+    // The key is the identity of the descriptor that is mapped, not of whatever the path names later
+    if (!opened)
     {
-        if (!check_file_data_64(&file, filename))
-            return (0);
-        get_symbols_64(&file);
+        local.fd = open(filename, O_RDONLY);
+        opened = &local;
     }
+    if (opened->fd >= 0 && !opened->stated)
+        opened->stated = !fstat(opened->fd, &opened->stats);
+
+    // Anything that is not a regular file goes through the usual error paths
+    if (!opened->stated || !S_ISREG(opened->stats.st_mode))
+        return process_file(filename, options, multiple_programs, output, stats, opened);
+    cache_key(&key, &opened->stats, options, name);
 
-    // Print file name if there are multiple programs
-    if (multiple_programs)
+    output_start = output_total(output);
+    if (cache_lookup(options.cache_directory, &key, name, output))
     {
-        write(1, "\n", 1);
-        write(1, filename, string_length(filename));
-        write(1, ":\n", 2);
+        close(opened->fd);
+        if (stats)
+        {
+            stats->cache_hits++;
+            stats->output_bytes += output_total(output) - output_start;
+        }
+        output_flush(output);
+        return (1);
     }
+    if (stats)
+        stats->cache_misses++;
+
+    // The whole output of the file is needed to store it
+    if (!output_init_memory(&file_output))
+        return process_file(filename, options, multiple_programs, output, stats, opened);
+    result = process_file(filename, options, multiple_programs, &file_output, stats, opened);
+    if (result)
+        cache_store(options.cache_directory, &key, name, file_output.buffer, file_output.length);
+    output_write(output, file_output.buffer, file_output.length);
+    output_release(&file_output);
+    output_flush(output);
+    return (result);
+}
+
+/**
+ * Job routine processing one file of the command line.
+ *
+ * @param context The FileJobs describing the run.
+ * @param index The index of the file to process.
+ * @param output The output the file's symbols and errors are appended to.
+ * @return 1 if the file is processed successfully, 0 otherwise.
+ */
+int process_file_job(void *context, size_t index, Output *output)
+{
+    FileJobs *jobs = context;
+    OpenedFile prefetched;
+    OpenedFile *opened = jobs->prefetch && prefetch_take(jobs->prefetch, index, &prefetched) ? &prefetched : NULL;
+    bool standard_input = !string_compare(jobs->files[index], "-");
 
-    // Sort symbols if necessary and print symbols
-    if (options.not_sorted == false)
+    // The prefetch opened a file named "-", the standard input is opened by get_file_data
+    if (opened && (standard_input || (jobs->errors && jobs->errors[index])))
     {
-        options.reverse ? reverse_quicksort_symbols(file.symbols + 1, file.symbol_count - 1) : quicksort_symbols(file.symbols + 1, file.symbol_count - 1);
+        if (opened->fd >= 0)
+            close(opened->fd);
+        opened = NULL;
     }
-    print_symbols(&file, options);
+    if (jobs->errors && jobs->errors[index])
+        return walk_error(output, jobs->files[index], jobs->errors[index]);
+
+    // Lookup addresses and search patterns are not part of the cache key, nor is a stream
+    if (jobs->options.cache_directory && !jobs->options.lookup && !jobs->options.find.pattern && !standard_input)
+        return process_file_cached(jobs->files[index], jobs->options, jobs->multiple_programs, output,
+                                   jobs->stats ? &jobs->stats[index] : NULL, opened);
+    return process_file(jobs->files[index], jobs->options, jobs->multiple_programs, output,
+                        jobs->stats ? &jobs->stats[index] : NULL, opened);
+}
 
-    // Free memory and cleanup
-    free(file.symbols);
+/**
+ * Collects the global symbols of one object, shared object or archive member
+ * into the link table. Shared objects contribute their dynamic symbols, the
+ * only ones a link sees.
+ *
+ * @param file The File structure holding the mapped image.
+ * @param name The name used in error messages.
+ * @param table The link table.
+ * @param unit The id of the unit.
+ * @param member The archive member being collected, or NULL for a file.
+ * @return 1 if the unit is collected successfully, 0 otherwise.
+ */
+int collect_link_unit(File *file, char *name, LinkTable *table, uint64_t unit, LinkMember *member)
+{
+    Options options = table->options;
+    int result;
+
+    options.all = 0;
+    options.undefined = 0;
+    options.globals = 1;
+    options.dynamic = link_shared_object(file);
+    if (!file->reader->check_file_data(file, name, options))
+        return (0);
+    if (!file->symbol_table)
+        return (1);
+    if (!file->reader->get_symbols(file, options))
+    {
+        free_file_tables(file);
+        return (0);
+    }
+    result = link_collect(table, file, unit, member);
+    free_symbol_table(&file->symbols);
+    free_file_tables(file);
+    return (result);
+}
+
+/**
+ * Job routine collecting one member of an archive straight from the archive mapping.
+ *
+ * @param context The LinkArchiveJobs of the archive.
+ * @param index The index of the member to collect.
+ * @param output The output the member's errors are appended to.
+ * @return 1 if the member is collected successfully, 0 otherwise.
+ */
+int link_member_job(void *context, size_t index, Output *output)
+{
+    LinkArchiveJobs *jobs = context;
+    ArchiveMember *member = &jobs->archive->members[index];
+    File file = {0};
+
+    file.elf_header = member->data;
+    file.file_size = member->size;
+    file.output = output;
+    if (!get_elf_type(&file, member->name))
+        return (0);
+    return collect_link_unit(&file, member->name, jobs->table, LINK_UNIT(jobs->file, index + 1),
+                             &jobs->table->archives[jobs->file].members[index]);
+}
+
+/**
+ * Job routine collecting one file of the command line, an archive's members
+ * in parallel.
+ *
+ * @param context The LinkTable being filled.
+ * @param index The index of the file to collect.
+ * @param output The output the file's errors are appended to.
+ * @return 1 if the file is collected successfully, 0 otherwise.
+ */
+int link_file_job(void *context, size_t index, Output *output)
+{
+    LinkTable *table = context;
+    LinkArchive *links = &table->archives[index];
+    char *name = table->files[index];
+    Archive archive = {0};
+    LinkArchiveJobs jobs = {table, &archive, index};
+    File file = {0};
+    int result;
+
+    file.output = output;
+    if (!get_file_data(&file, name, NULL))
+    {
+        if (file.elf_header)
+            munmap(file.elf_header, file.file_size);
+        return file_errors(output, ": ", name, ": No such file or directory\n");
+    }
+
+    if (file.file_type != ARCHIVE)
+        result = collect_link_unit(&file, name, table, LINK_UNIT(index, 0), NULL);
+    else if ((result = read_archive(&archive, &file, name)))
+    {
+        // Member names outlive the archive mapping, they are needed by the report
+        if (!(links->members = calloc(archive.member_count + 1, sizeof(LinkMember))))
+            result = 0;
+        for (size_t n = 0; result && n < archive.member_count; n++)
+            if (!(links->members[links->member_count++].name = link_member_name(name, archive.members[n].name)))
+                result = 0;
+        if (result)
+            result = !run_ordered_jobs(link_member_job, &jobs, archive.member_count, table->options.jobs, output);
+        free_archive(&archive);
+    }
     munmap(file.elf_header, file.file_size);
+    output_flush(output);
+    return (result);
+}
 
+/**
+ * Checks that the files would link: every file and archive member is
+ * collected in parallel into the shared table, archive members are then
+ * linked as needed, and only the unresolved references and the multiple
+ * definitions are printed.
+ *
+ * @param jobs The files of the command line and the options.
+ * @param file_count The number of files.
+ * @param output The output the report is appended to.
+ * @return The number of files that failed plus the number of problems found.
+ */
+size_t check_link(FileJobs *jobs, size_t file_count, Output *output)
+{
+    LinkTable *table;
+    size_t failures;
+    size_t problems;
+
+    if (!(table = link_table_init(jobs->files, file_count, jobs->options)))
+        return file_count;
+    table->options.jobs = share_job_budget(jobs->options.jobs, file_count);
+    failures = run_ordered_jobs(link_file_job, table, file_count, jobs->options.jobs, output);
+    if (!link_resolve(table) || (problems = link_report(table, output)) == SIZE_MAX)
+        failures++;
+    else
+        failures += problems;
+    link_table_free(table, file_count);
+    return failures;
+}
+
+/**
+ * Job routine extracting and sorting the symbols of one of the two files
+ * being compared. The files stay mapped for the merge.
+ *
+ * @param context The two File structures.
+ * @param index The index of the file to load.
+ * @param output The output the file's errors are appended to.
+ * @return 1 if the file is loaded successfully, 0 otherwise.
+ */
+int load_diff_job(void *context, size_t index, Output *output)
+{
+    DiffFiles *diff = context;
+    File *file = &diff->files[index];
+    char *name = diff->names[index];
+
+    file->output = output;
+    if (!get_file_data(file, name, NULL))
+        return file_errors(output, ": ", name, ": No such file or directory\n");
+    if (file->file_type == ARCHIVE)
+        return file_errors(output, ": ", name, ": archives cannot be compared\n");
+    if (!file->reader->check_file_data(file, name, diff->options))
+        return (0);
+    if (!file->symbol_table)
+        return file_errors(output, ": ", name, ": no symbols\n");
+    if (!(diff->options.find.pattern ? file->reader->find_symbols : file->reader->get_symbols)(file, diff->options))
+        return (0);
+    if (diff->options.demangle && !demangle_symbols(file, diff->options.demangle, diff->options.jobs))
+        return (0);
+    sort_symbols(file, diff->options);
     return (1);
 }
 
+/**
+ * Compares the symbols of two files: both are extracted and sorted in
+ * parallel, then merged in one streaming pass.
+ *
+ * @param names The names of the old and the new file.
+ * @param options The options selecting the symbols and the comparison.
+ * @param output The output the differences are appended to.
+ * @return DIFF_SAME, DIFF_DIFFERENT, or DIFF_TROUBLE if a file could not be compared.
+ */
+int diff_files(char **names, Options options, Output *output)
+{
+    DiffFiles diff = {{{0}}, names, options};
+    size_t differences = SIZE_MAX;
+
+    // The merge walks both files in byte order
+    diff.options.reverse = 0;
+    diff.options.collate = 0;
+    diff.options.jobs = share_job_budget(options.jobs, 2);
+    if (!run_ordered_jobs(load_diff_job, &diff, 2, options.jobs, output))
+    {
+        diff.files[0].output = output;
+        diff.files[1].output = output;
+        differences = diff_symbols(&diff.files[0], &diff.files[1], diff.options);
+    }
+    for (int n = 0; n < 2; n++)
+    {
+        free_symbol_table(&diff.files[n].symbols);
+        free_file_tables(&diff.files[n]);
+        if (diff.files[n].elf_header)
+            munmap(diff.files[n].elf_header, diff.files[n].file_size);
+    }
+    output_flush(output);
+    if (differences == SIZE_MAX)
+        return (DIFF_TROUBLE);
+    return (differences ? DIFF_DIFFERENT : DIFF_SAME);
+}
+
+/**
+ * Walks the -R trees and appends the ELF files and archives they hold to the
+ * files of the command line, tree after tree, each in path order.
+ *
+ * @param options The options holding the trees and the job count.
+ * @param files The files of the command line, a malloc'd array grown in place.
+ * @param errors Receives the errno of every file, 0 except for unreadable directories.
+ * @param file_count The number of files of the command line.
+ * @return The number of files appended, or -1 if memory ran out.
+ */
+int walk_directories(Options options, char ***files, int **errors, int file_count)
+{
+    WalkEntry *entries;
+    size_t count;
+    char **grown;
+    int *grown_errors;
+    int walked = 0;
+
+    *errors = calloc(file_count + 1, sizeof(int));
+    for (int n = 0; *errors && n < options.directory_count; n++)
+    {
+        if (!walk_tree(options.directories[n], options.jobs, &entries, &count))
+            return (-1);
+        grown = realloc(*files, sizeof(char *) * (file_count + walked + count + 1));
+        if (grown)
+            *files = grown;
+        grown_errors = grown ? realloc(*errors, sizeof(int) * (file_count + walked + count + 1)) : NULL;
+        if (grown_errors)
+            *errors = grown_errors;
+        for (size_t m = 0; m < count; m++)
+        {
+            if (grown_errors)
+            {
+                (*files)[file_count + walked] = entries[m].path;
+                (*errors)[file_count + walked++] = entries[m].error;
+            }
+            else
+                free(entries[m].path);
+        }
+        free(entries);
+        if (!grown_errors)
+            return (-1);
+    }
+    return (*errors ? walked : -1);
+}
+
 /**
  * The main entry point of the program.
  *
@@ -147,35 +786,108 @@ int process_file(char *filename, Options options, bool multiple_programs)
  */
 int main(int argc, char **argv)
 {
-    int arg_index;
-    int file_count = 0;
+    int file_count;
+    int given;
+    int owned;
+    int appended = 0;
+    size_t failures;
+    uint64_t start;
     Options options = {0};
+    Output output;
+    FileJobs jobs = {0};
+    Prefetch prefetch;
+    struct rusage usage;
+    char **files;
+
+    // Parse command line flags and collect the file names
+    if (!(files = malloc(sizeof(char *) * argc)) || !(options.directories = malloc(sizeof(char *) * argc)) ||
+        !(options.file_lists = malloc(sizeof(char *) * argc)))
+        return (EXIT_FAILURE);
+    file_count = parse_flags(&options, argc, argv, files);
+    given = file_count;
+    if (!options.jobs)
+        options.jobs = get_core_count();
+    if (!options.cache_limit)
+        options.cache_limit = CACHE_DEFAULT_LIMIT;
+    if (!options.serve_budget)
+        options.serve_budget = SERVE_DEFAULT_BUDGET;
+    if (options.lookup && !options.lookup_count)
+        read_lookup_addresses(&options);
+    if (options.collate)
+        setlocale(LC_COLLATE, "");
 
-    // Parse command line flags
-    parse_flags(&options, argc, argv);
+    // Allocate the output buffer shared by every file
+    if (!output_init(&output, 1))
+        return (EXIT_FAILURE);
+
+    // Files named by the lists, then the ones found in the -R trees, follow the ones of the command line
+    for (int n = 0; n < options.file_list_count && appended >= 0; n++)
+        if ((appended = read_file_list(options.file_lists[n], &files, file_count, &output)) >= 0)
+            file_count += appended;
+    if (appended >= 0 && options.directory_count &&
+        (appended = walk_directories(options, &files, &jobs.errors, file_count)) >= 0)
+        file_count += appended;
+    if (appended < 0)
+    {
+        output_release(&output);
+        return (EXIT_FAILURE);
+    }
+    owned = file_count - given;
 
-    // Get the number of files
-    file_count = get_file_count(argc, argv);
+    // Process default file "a.out" when no file is given
+    jobs.files = file_count || options.directory_count || options.file_list_count ? files : (char *[]){"a.out"};
+    jobs.options = options;
+    jobs.multiple_programs = file_count > 1 || options.directory_count;
+    if (!file_count && !options.directory_count && !options.file_list_count)
+        file_count = 1;
+    jobs.stats = options.stats ? calloc(file_count, sizeof(Stats)) : NULL;
 
-    if (file_count == 0)
+    // Answer queries until the server fails, or process every file, in parallel when several jobs are allowed
+    start = clock_ns();
+    be_zero(&usage, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+    if (options.serve_socket)
+        failures = !serve(options, &output);
+    else if (options.diff && file_count != 2)
     {
-        // Process default file "a.out"
-        if (!process_file("a.out", options, 0))
-            return (EXIT_FAILURE);
+        write(2, "ft_nm: --diff needs exactly two files\n", 38);
+        failures = 1;
     }
+    else if (options.diff)
+        failures = diff_files(jobs.files, options, &output);
+    else if (options.link_check)
+        failures = check_link(&jobs, file_count, &output);
     else
     {
-        // Process each file
-        arg_index = 0;
-        while (++arg_index < argc)
-        {
-            if (argv[arg_index][0] != '-')
-            {
-                if (!process_file(argv[arg_index], options, file_count > 1))
-                    return (EXIT_FAILURE);
-            }
-        }
+        // Opens and stats are batched ahead of the jobs when io_uring is available
+        jobs.prefetch = prefetch_init(&prefetch, jobs.files, file_count) ? &prefetch : NULL;
+        // Files processed side by side split the threads of the run between them
+        jobs.options.jobs = share_job_budget(options.jobs, file_count);
+        failures = run_ordered_jobs(process_file_job, &jobs, file_count, options.jobs, &output);
+        if (jobs.prefetch)
+            prefetch_free(&prefetch);
     }
 
-    return (EXIT_SUCCESS);
+    // Flush whatever is left in the output buffer
+    output_flush(&output);
+
+    // Keep the cache directory under its size cap
+    if (options.cache_directory)
+        cache_evict(options.cache_directory, options.cache_limit);
+    if (jobs.stats)
+        print_stats(options.stats, jobs.files, jobs.stats, file_count, output.write_calls, clock_ns() - start,
+                    &usage);
+    output_release(&output);
+    free(jobs.stats);
+    free(options.lookup_addresses);
+    demangle_cache_free(options.demangle);
+    for (int n = given; n < given + owned; n++)
+        free(files[n]);
+    free(jobs.errors);
+    free(options.directories);
+    free(options.file_lists);
+    free(files);
+    if (options.diff)
+        return (file_count == 2 ? (int)failures : DIFF_TROUBLE);
+    return (failures ? EXIT_FAILURE : EXIT_SUCCESS);
 }
@@ -0,0 +1,66 @@
+#!/bin/sh
+# Times ft_nm against the system nm on synthetic objects.
+#
+# Environment:
+#   BENCH_SIZES    symbol counts to generate (default: 1000 100000 1000000)
+#   BENCH_CLASSES  ELF classes to generate (default: 64 32)
+#   BENCH_ORDERS   symbol orders to generate (default: random sorted reverse)
+#   BENCH_LENGTHS  name length range as min:max (default: 8:32)
+#   BENCH_DUPLICATES  fraction of symbols reusing an earlier name (default: 0)
+#   BENCH_OPTIONS  option sets to time, separated by commas (default: ,-p,-r,-u,-g)
+#   BENCH_RUNS     runs per measurement, the fastest is kept (default: 3)
+#   BENCH_NM       reference nm (default: nm, skipped when missing)
+
+BENCH_DIR=$(dirname "$0")
+FT_NM=${FT_NM:-./ft_nm}
+SIZES=${BENCH_SIZES:-1000 100000 1000000}
+CLASSES=${BENCH_CLASSES:-64 32}
+ORDERS=${BENCH_ORDERS:-random sorted reverse}
+LENGTHS=${BENCH_LENGTHS:-8:32}
+DUPLICATES=${BENCH_DUPLICATES:-0}
+OPTIONS=${BENCH_OPTIONS:-,-p,-r,-u,-g}
+RUNS=${BENCH_RUNS:-3}
+NM=${BENCH_NM:-nm}
+INPUTS="$BENCH_DIR/inputs"
+
+command -v "$NM" > /dev/null 2>&1 || NM=
+
+# Prints "seconds peak_rss_kb" for the fastest of RUNS runs of a command
+measure()
+{
+    best=
+    run=0
+    while [ $run -lt "$RUNS" ]; do
+        result=$("$BENCH_DIR/measure" "$@") || return 1
+        best=$(printf '%s\n%s\n' "$best" "$result" | awk 'NF { if (!n++ || $1 < t) { t = $1; r = $2 } } END { print t, r }')
+        run=$((run + 1))
+    done
+    echo "$best"
+}
+
+# Prints one result line: input, options, tool, time, symbols/s and peak RSS
+report()
+{
+    echo "$5" | awk -v input="$1" -v options="$2" -v tool="$3" -v symbols="$4" \
+        '{ printf "%-36s %-8s %-6s %10.4f %14.0f %10d\n", input, options, tool, $1, ($1 > 0 ? symbols / $1 : 0), $2 }'
+}
+
+mkdir -p "$INPUTS"
+printf "%-36s %-8s %-6s %10s %14s %10s\n" input options tool seconds symbols/s rss_kb
+for bits in $CLASSES; do
+    for size in $SIZES; do
+        for order in $ORDERS; do
+            input="$INPUTS/elf${bits}_${size}_${order}_${LENGTHS%:*}-${LENGTHS#*:}_${DUPLICATES}.o"
+            [ -f "$input" ] || "$BENCH_DIR/gen_elf" -b "$bits" -n "$size" -o "$order" -l "$LENGTHS" -d "$DUPLICATES" \
+                "$input" || exit 1
+            echo "$OPTIONS" | tr ',' '\n' | while read -r option; do
+                label=${option:-default}
+                result=$(measure "$FT_NM" $option "$input") || { echo "$FT_NM $option $input failed" >&2; exit 1; }
+                report "$(basename "$input")" "$label" ft_nm "$size" "$result"
+                if [ -n "$NM" ]; then
+                    result=$(measure "$NM" $option "$input") && report "$(basename "$input")" "$label" nm "$size" "$result"
+                fi
+            done || exit 1
+        done
+    done
+done
@@ -0,0 +1,331 @@
+#include <elf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Sections of the generated object, in section header order
+enum
+{
+    SECTION_NULL,
+    SECTION_TEXT,
+    SECTION_DATA,
+    SECTION_BSS,
+    SECTION_RODATA,
+    SECTION_SYMTAB,
+    SECTION_STRTAB,
+    SECTION_SHSTRTAB,
+    SECTION_COUNT
+};
+
+typedef struct Config
+{
+    int bits;
+    size_t count;
+    size_t min_length;
+    size_t max_length;
+    double duplicates;
+    char order; // 'r'andom, 's'orted or 'v' for reverse-sorted
+    unsigned seed;
+    char *path;
+} Config;
+
+typedef struct GeneratedSymbol
+{
+    uint32_t name;
+    uint8_t info;
+    uint16_t shndx;
+    uint64_t value;
+} GeneratedSymbol;
+
+static char *strings;
+
+/**
+ * Prints the usage of the generator and exits.
+ *
+ * @param program The name of the generator.
+ */
+void usage(char *program)
+{
+    fprintf(stderr,
+            "usage: %s [-b 32|64] [-n count] [-l min:max] [-d duplicate_ratio] [-o random|sorted|reverse] [-s seed] output\n",
+            program);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Parses the command line into a generator configuration.
+ *
+ * @param config The configuration to fill.
+ * @param argc The number of command line arguments.
+ * @param argv The array of command line arguments.
+ */
+void parse_config(Config *config, int argc, char **argv)
+{
+    int option;
+
+    *config = (Config){64, 1000, 8, 32, 0.0, 'r', 42, NULL};
+    while ((option = getopt(argc, argv, "b:n:l:d:o:s:")) != -1)
+    {
+        switch (option)
+        {
+        case 'b':
+            config->bits = atoi(optarg);
+            break;
+        case 'n':
+            config->count = strtoull(optarg, NULL, 10);
+            break;
+        case 'l':
+            if (sscanf(optarg, "%zu:%zu", &config->min_length, &config->max_length) != 2)
+                usage(argv[0]);
+            break;
+        case 'd':
+            config->duplicates = atof(optarg);
+            break;
+        case 'o':
+            config->order = optarg[0] == 'r' && optarg[2] == 'v' ? 'v' : optarg[0];
+            break;
+        case 's':
+            config->seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || (config->bits != 32 && config->bits != 64) || !config->min_length ||
+        config->min_length > config->max_length || !strchr("rsv", config->order))
+        usage(argv[0]);
+    config->path = argv[optind];
+}
+
+/**
+ * Orders two symbols by name.
+ */
+int compare_names(const void *a, const void *b)
+{
+    return strcmp(strings + ((const GeneratedSymbol *)a)->name, strings + ((const GeneratedSymbol *)b)->name);
+}
+
+/**
+ * Orders two symbols by name, descending.
+ */
+int compare_names_reverse(const void *a, const void *b)
+{
+    return compare_names(b, a);
+}
+
+/**
+ * Generates the symbols and their string table. Names are random identifiers
+ * with a length drawn uniformly from the configured range; a `duplicates`
+ * fraction of the symbols reuses the name of an earlier one. Bind, type and
+ * section are spread to exercise every filter and type letter.
+ *
+ * @param config The generator configuration.
+ * @param symbols The array receiving `count` symbols.
+ * @param string_size The size of the generated string table.
+ */
+void generate_symbols(Config *config, GeneratedSymbol *symbols, size_t *string_size)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+    size_t offset = 1;
+    size_t length;
+    unsigned kind;
+
+    srand(config->seed);
+    for (size_t n = 0; n < config->count; n++)
+    {
+        // Pick a name, either new or reused from an earlier symbol
+        if (n && (double)rand() / RAND_MAX < config->duplicates)
+            symbols[n].name = symbols[rand() % n].name;
+        else
+        {
+            length = config->min_length + rand() % (config->max_length - config->min_length + 1);
+            symbols[n].name = offset;
+            strings[offset++] = alphabet[rand() % 53]; // Identifiers never start with a digit
+            for (size_t c = 1; c < length; c++)
+                strings[offset++] = alphabet[rand() % (sizeof(alphabet) - 1)];
+            strings[offset++] = '\0';
+        }
+
+        // Spread the symbols over the usual bind, type and section combinations
+        kind = rand() % 20;
+        symbols[n].value = (uint64_t)n * 16;
+        if (kind < 12)
+            symbols[n] = (GeneratedSymbol){symbols[n].name, ELF64_ST_INFO(STB_GLOBAL, STT_FUNC), SECTION_TEXT, symbols[n].value};
+        else if (kind < 14)
+            symbols[n] = (GeneratedSymbol){symbols[n].name, ELF64_ST_INFO(STB_LOCAL, STT_FUNC), SECTION_TEXT, symbols[n].value};
+        else if (kind < 15)
+            symbols[n] = (GeneratedSymbol){symbols[n].name, ELF64_ST_INFO(STB_LOCAL, STT_OBJECT), SECTION_DATA, symbols[n].value};
+        else if (kind < 16)
+            symbols[n] = (GeneratedSymbol){symbols[n].name, ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT), SECTION_BSS, symbols[n].value};
+        else if (kind < 17)
+            symbols[n] = (GeneratedSymbol){symbols[n].name, ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT), SECTION_RODATA, symbols[n].value};
+        else if (kind < 19)
+            symbols[n] = (GeneratedSymbol){symbols[n].name, ELF64_ST_INFO(STB_GLOBAL, STT_FUNC), SHN_UNDEF, 0};
+        else
+            symbols[n] = (GeneratedSymbol){symbols[n].name, ELF64_ST_INFO(STB_WEAK, STT_FUNC), SECTION_TEXT, symbols[n].value};
+    }
+    *string_size = offset;
+
+    if (config->order == 's')
+        qsort(symbols, config->count, sizeof(GeneratedSymbol), compare_names);
+    else if (config->order == 'v')
+        qsort(symbols, config->count, sizeof(GeneratedSymbol), compare_names_reverse);
+}
+
+/**
+ * Writes the generated object. The layout is the ELF header, the contents of
+ * .text/.data/.rodata, the symbol table, the string tables and finally the
+ * section header table.
+ *
+ * @param config The generator configuration.
+ * @param symbols The generated symbols.
+ * @param string_size The size of the string table.
+ * @param output The stream to write to.
+ */
+void write_object(Config *config, GeneratedSymbol *symbols, size_t string_size, FILE *output)
+{
+    static const char section_names[] = "\0.text\0.data\0.bss\0.rodata\0.symtab\0.strtab\0.shstrtab";
+    static const uint32_t name_offsets[SECTION_COUNT] = {0, 1, 7, 13, 18, 26, 34, 42};
+    static const uint32_t types[SECTION_COUNT] = {SHT_NULL, SHT_PROGBITS, SHT_PROGBITS, SHT_NOBITS,
+                                                  SHT_PROGBITS, SHT_SYMTAB, SHT_STRTAB, SHT_STRTAB};
+    static const uint64_t flags[SECTION_COUNT] = {0, SHF_ALLOC | SHF_EXECINSTR, SHF_ALLOC | SHF_WRITE,
+                                                  SHF_ALLOC | SHF_WRITE, SHF_ALLOC, 0, 0, 0};
+    bool wide = config->bits == 64;
+    size_t header_size = wide ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr);
+    size_t symbol_size = wide ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+    size_t content_size = 16;
+    uint64_t offsets[SECTION_COUNT] = {0};
+    uint64_t sizes[SECTION_COUNT] = {0};
+    uint64_t cursor;
+
+    // Lay the sections out one after the other, 8-byte aligned
+    cursor = header_size;
+    for (int s = SECTION_TEXT; s < SECTION_COUNT; s++)
+    {
+        cursor = (cursor + 7) & ~7ULL;
+        offsets[s] = cursor;
+        sizes[s] = s == SECTION_SYMTAB     ? (config->count + 1) * symbol_size
+                   : s == SECTION_STRTAB   ? string_size
+                   : s == SECTION_SHSTRTAB ? sizeof(section_names)
+                                           : content_size;
+        if (types[s] != SHT_NOBITS)
+            cursor += sizes[s];
+    }
+    cursor = (cursor + 7) & ~7ULL;
+
+    // ELF header
+    if (wide)
+    {
+        Elf64_Ehdr header = {.e_type = ET_REL, .e_machine = EM_X86_64, .e_version = EV_CURRENT, .e_shoff = cursor,
+                             .e_ehsize = sizeof(Elf64_Ehdr), .e_shentsize = sizeof(Elf64_Shdr),
+                             .e_shnum = SECTION_COUNT, .e_shstrndx = SECTION_SHSTRTAB};
+        memcpy(header.e_ident, ELFMAG, SELFMAG);
+        header.e_ident[EI_CLASS] = ELFCLASS64;
+        header.e_ident[EI_DATA] = ELFDATA2LSB;
+        header.e_ident[EI_VERSION] = EV_CURRENT;
+        fwrite(&header, sizeof(header), 1, output);
+    }
+    else
+    {
+        Elf32_Ehdr header = {.e_type = ET_REL, .e_machine = EM_386, .e_version = EV_CURRENT, .e_shoff = cursor,
+                             .e_ehsize = sizeof(Elf32_Ehdr), .e_shentsize = sizeof(Elf32_Shdr),
+                             .e_shnum = SECTION_COUNT, .e_shstrndx = SECTION_SHSTRTAB};
+        memcpy(header.e_ident, ELFMAG, SELFMAG);
+        header.e_ident[EI_CLASS] = ELFCLASS32;
+        header.e_ident[EI_DATA] = ELFDATA2LSB;
+        header.e_ident[EI_VERSION] = EV_CURRENT;
+        fwrite(&header, sizeof(header), 1, output);
+    }
+
+    // Section contents
+    for (int s = SECTION_TEXT; s < SECTION_COUNT; s++)
+    {
+        if (types[s] == SHT_NOBITS)
+            continue;
+        while ((uint64_t)ftell(output) < offsets[s])
+            fputc(0, output);
+        if (s == SECTION_SYMTAB)
+        {
+            for (size_t n = 0; n <= config->count; n++)
+            {
+                GeneratedSymbol symbol = n ? symbols[n - 1] : (GeneratedSymbol){0};
+                if (wide)
+                {
+                    Elf64_Sym entry = {symbol.name, symbol.info, STV_DEFAULT, symbol.shndx, symbol.value, 0};
+                    fwrite(&entry, sizeof(entry), 1, output);
+                }
+                else
+                {
+                    Elf32_Sym entry = {symbol.name, (Elf32_Addr)symbol.value, 0, symbol.info, STV_DEFAULT, symbol.shndx};
+                    fwrite(&entry, sizeof(entry), 1, output);
+                }
+            }
+        }
+        else if (s == SECTION_STRTAB)
+            fwrite(strings, 1, string_size, output);
+        else if (s == SECTION_SHSTRTAB)
+            fwrite(section_names, 1, sizeof(section_names), output);
+        else
+            for (size_t n = 0; n < content_size; n++)
+                fputc(0, output);
+    }
+    while ((uint64_t)ftell(output) < cursor)
+        fputc(0, output);
+
+    // Section header table
+    for (int s = 0; s < SECTION_COUNT; s++)
+    {
+        uint32_t link = s == SECTION_SYMTAB ? SECTION_STRTAB : 0;
+        uint32_t info = s == SECTION_SYMTAB ? 1 : 0;
+        if (wide)
+        {
+            Elf64_Shdr header = {name_offsets[s], types[s], flags[s], 0, s ? offsets[s] : 0, sizes[s], link, info,
+                                 s ? 8 : 0, s == SECTION_SYMTAB ? sizeof(Elf64_Sym) : 0};
+            fwrite(&header, sizeof(header), 1, output);
+        }
+        else
+        {
+            Elf32_Shdr header = {name_offsets[s], types[s], (Elf32_Word)flags[s], 0, (Elf32_Off)offsets[s],
+                                 (Elf32_Word)sizes[s], link, info, s ? 4 : 0,
+                                 s == SECTION_SYMTAB ? sizeof(Elf32_Sym) : 0};
+            fwrite(&header, sizeof(header), 1, output);
+        }
+    }
+}
+
+/**
+ * Writes a synthetic relocatable ELF object with a configurable number of
+ * symbols, name length distribution, symbol order and duplicate ratio.
+ */
+int main(int argc, char **argv)
+{
+    Config config;
+    GeneratedSymbol *symbols;
+    size_t string_size;
+    FILE *output;
+
+    parse_config(&config, argc, argv);
+    symbols = malloc(sizeof(GeneratedSymbol) * (config.count ? config.count : 1));
+    strings = malloc(config.count * (config.max_length + 1) + 1);
+    if (!symbols || !strings)
+    {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    strings[0] = '\0';
+    generate_symbols(&config, symbols, &string_size);
+
+    if (!(output = fopen(config.path, "wb")))
+    {
+        perror(config.path);
+        return EXIT_FAILURE;
+    }
+    write_object(&config, symbols, string_size, output);
+    fclose(output);
+    free(strings);
+    free(symbols);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/**
+ * Runs a command with its standard output discarded and prints its wall
+ * time in seconds and its peak resident set size in kilobytes.
+ */
+int main(int argc, char **argv)
+{
+    struct timespec start, end;
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s command [arguments...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((pid = fork()) < 0)
+    {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (!pid)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        execvp(argv[1], argv + 1);
+        perror(argv[1]);
+        _exit(127);
+    }
+    if (wait4(pid, &status, 0, &usage) < 0)
+    {
+        perror("wait4");
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%.6f %ld\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, usage.ru_maxrss);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}